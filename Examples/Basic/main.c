@@ -3,21 +3,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <termios.h>
 #include <stdio.h>
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#define HISTORY_FILE                ".mycli_history"
+#define HISTORY_COMPACT_SIZE        (4*sizeof(g_HistoryBuff))   // Rewrite the history file when it gets this big
+
 struct termios orig_termios;
 
 char g_LineBuff[100];
 char g_HistoryBuff[1000];
+FILE *g_HistoryFile;
 
 void SetupIO(void);
 void ShutDownIO(void);
+void LoadHistory(struct CLIHandle *Prompt);
 
 int quit=false;
 
@@ -29,7 +36,7 @@ const struct CLICommand g_CLICmds[]=
 {
     {"Quit","Quit the program",quitfn},
     {"Help","Get help",helpfn},
-    {"Drive","Example of the help / auto complete",Drivefn},
+    {"Drive","Example of the help / auto complete",Drivefn,true},
 };
 
 unsigned int g_CLICmdsCount=sizeof(g_CLICmds)/sizeof(struct CLICommand);
@@ -37,6 +44,7 @@ unsigned int g_CLICmdsCount=sizeof(g_CLICmds)/sizeof(struct CLICommand);
 int main(void)
 {
     struct CLIHandle *Prompt;
+    struct winsize ws;
 
     SetupIO();
 
@@ -46,11 +54,18 @@ int main(void)
 
     CLI_InitPrompt(Prompt);
     CLI_SetLineBuffer(Prompt,g_LineBuff,100);
-    CLI_SetHistoryBuffer(Prompt,g_HistoryBuff,100);
+    CLI_SetHistoryBuffer(Prompt,g_HistoryBuff,sizeof(g_HistoryBuff));
+    LoadHistory(Prompt);
+
+    /* Scroll long lines instead of wrapping them */
+    if(ioctl(1,TIOCGWINSZ,&ws)==0)
+        CLI_SetTermWidth(Prompt,ws.ws_col);
 
     CLI_DrawPrompt(Prompt);
     while(!quit)
     {
+        /* Sleep until there is something for the prompt to do */
+        CLI_WaitForInput(Prompt,CLI_WAIT_FOREVER);
         CLI_RunCmdPrompt(Prompt);
     }
 
@@ -77,6 +92,67 @@ void SetupIO(void)
 void ShutDownIO(void)
 {
     tcsetattr(0, TCSANOW, &orig_termios);
+}
+
+/* Load the end of the history file (only what will fit in the history
+   buffer, the rest would just be dropped).  If the file has gotten big
+   it's cut down to what we loaded, then it's opened to add new lines. */
+void LoadHistory(struct CLIHandle *Prompt)
+{
+    static char Tail[sizeof(g_HistoryBuff)+1];
+    FILE *in;
+    FILE *out;
+    long Size;
+    size_t Bytes;
+    char *Start;
+    char *Line;
+    char *End;
+
+    Bytes=0;
+    Size=0;
+    in=fopen(HISTORY_FILE,"rb");
+    if(in!=NULL)
+    {
+        fseek(in,0,SEEK_END);
+        Size=ftell(in);
+        if(Size>(long)sizeof(g_HistoryBuff))
+            fseek(in,Size-sizeof(g_HistoryBuff),SEEK_SET);
+        else
+            fseek(in,0,SEEK_SET);
+        Bytes=fread(Tail,1,sizeof(g_HistoryBuff),in);
+        fclose(in);
+    }
+    Tail[Bytes]=0;
+
+    /* If we started in the middle of the file skip the partial line */
+    Start=Tail;
+    if(Size>(long)sizeof(g_HistoryBuff))
+    {
+        Start=strchr(Tail,'\n');
+        Start=Start==NULL?&Tail[Bytes]:Start+1;
+    }
+
+    if(Size>(long)HISTORY_COMPACT_SIZE)
+    {
+        out=fopen(HISTORY_FILE ".new","wb");
+        if(out!=NULL)
+        {
+            fwrite(Start,1,&Tail[Bytes]-Start,out);
+            if(fclose(out)==0)
+                rename(HISTORY_FILE ".new",HISTORY_FILE);
+        }
+    }
+
+    for(Line=Start;*Line!=0;Line=End+1)
+    {
+        End=strchr(Line,'\n');
+        if(End==NULL)
+            break;
+        *End=0;
+        CLI_AddHistoryEntry(Prompt,Line);
+    }
+
+    g_HistoryFile=fopen(HISTORY_FILE,"ab");
 }
 
 bool HAL_CLI_IsCharAvailable(void)
@@ -100,12 +176,38 @@ char HAL_CLI_GetChar(void)
     {
         return c;
     }
+}
+
+bool HAL_CLI_WaitForInput(uint32_t Timeout)
+{
+    struct pollfd fds;
+
+    fds.fd=0;
+    fds.events=POLLIN;
+    return poll(&fds,1,Timeout==CLI_WAIT_FOREVER?-1:(int)Timeout)>0;
 }
 
 void HAL_CLI_PutChar(char c)
 {
     putchar(c);
+    fflush(stdout);
+}
+
+void HAL_CLI_Write(const char *Buff,int Bytes)
+{
+    fwrite(Buff,1,Bytes,stdout);
     fflush(stdout);
+}
+
+void HAL_CLI_SaveHistory(const char *Line,unsigned int Len)
+{
+    if(g_HistoryFile==NULL)
+        return;
+
+    /* Just hand it to the OS, no need to wait for the disk */
+    fwrite(Line,1,Len,g_HistoryFile);
+    fputc('\n',g_HistoryFile);
+    fflush(g_HistoryFile);
 }
 
 uint32_t HAL_CLI_GetMilliSecCounter(void)
@@ -137,19 +239,25 @@ void Drivefn(int argc,const char **argv)
         CLI_CmdHelp_Start();
 
         CLI_CmdHelp_Arg("Disk","What disk to work on");
+        CLI_CmdHelp_ArgType(e_CLIArg_Option);
         CLI_CmdHelp_OptionString(0,"df0","Floppy disk 1");
         CLI_CmdHelp_OptionString(0,"df1","Floppy disk 2");
         CLI_CmdHelp_OptionString(0,"dh0","Hard drive 1");
 
         CLI_CmdHelp_Arg("Function","Preform disk functions");
+        CLI_CmdHelp_ArgType(e_CLIArg_Option);
         // Read fn
         CLI_CmdHelp_OptionString(1,"Read","Read from the disk");
         CLI_CmdHelp_SubArg("Offset","The offset into the disk to read");
+        CLI_CmdHelp_ArgType(e_CLIArg_Hex);
         CLI_CmdHelp_SubArg("Bytes","The number of bytes to read");
+        CLI_CmdHelp_ArgType(e_CLIArg_Int);
         // Write fn
         CLI_CmdHelp_OptionString(1,"Write","Write to the disk");
         CLI_CmdHelp_SubArg("Offset","The number of bytes to write");
+        CLI_CmdHelp_ArgType(e_CLIArg_Hex);
         CLI_CmdHelp_SubArg("Bytes","The number of bytes to write");
+        CLI_CmdHelp_ArgType(e_CLIArg_Int);
         // Format fn
         CLI_CmdHelp_OptionString(1,"Format","Format the disk");
 
@@ -163,55 +271,40 @@ void Drivefn(int argc,const char **argv)
         return;
     }
 
-    if(strcasecmp(argv[1],"df0")==0)
+    /* The args where checked before we where called (TypedArgs is set in
+       g_CLICmds) so we get the index of the option and the numbers */
+    switch(CLI_GetArgValue(1))
     {
-        printf("Floppy disk 1\r\n");
-    }
-    else if(strcasecmp(argv[1],"df1")==0)
-    {
-        printf("Floppy disk 1\r\n");
-    }
-    else if(strcasecmp(argv[1],"dh0")==0)
-    {
-        printf("Harddrive\n");
-    }
-    else
-    {
-        printf("unknown disk\r\n");
-        return;
+        case 0:
+            printf("Floppy disk 1\r\n");
+        break;
+        case 1:
+            printf("Floppy disk 2\r\n");
+        break;
+        case 2:
+        default:
+            printf("Harddrive\r\n");
+        break;
     }
 
-    if(strcasecmp(argv[2],"Read")==0)
+    switch(CLI_GetArgValue(2))
     {
-        if(argc<5)
-        {
-            printf("Missing args\r\n");
-            return;
-        }
-        bytes=atoi(argv[4]);
-        offset=atoi(argv[3]);
-
-        printf("Reading %d bytes at offset %d\r\n",bytes,offset);
-    }
-    else if(strcasecmp(argv[2],"Write")==0)
-    {
-        if(argc<5)
-        {
-            printf("Missing args\r\n");
-            return;
-        }
-        bytes=atoi(argv[4]);
-        offset=atoi(argv[3]);
+        case 0: // Read
+        case 1: // Write
+            if(argc<5)
+            {
+                printf("Missing args\r\n");
+                return;
+            }
+            offset=CLI_GetArgValue(3);
+            bytes=CLI_GetArgValue(4);
 
-        printf("Writing %d bytes at offset %d\r\n",bytes,offset);
-    }
-    else if(strcasecmp(argv[2],"Format")==0)
-    {
-        printf("Formating...\r\n");
-    }
-    else
-    {
-        printf("unknown function\r\n");
-        return;
+            printf("%s %d bytes at offset 0x%X\r\n",
+                    CLI_GetArgValue(2)==0?"Reading":"Writing",bytes,offset);
+        break;
+        case 2: // Format
+        default:
+            printf("Formating...\r\n");
+        break;
     }
 }
@@ -0,0 +1,846 @@
+/*******************************************************************************
+ * FILENAME: CLI_TelnetServer.c
+ *
+ * PROJECT:
+ *    MyCLI
+ *
+ * FILE DESCRIPTION:
+ *    This file has a telnet server that can have many sessions open at once
+ *    (one prompt per connection).  It uses epoll with nonblocking sockets
+ *    in edge triggered mode so it only does work for the sessions that have
+ *    something going on.
+ *
+ *    The CLI HAL functions work on the "current session", which is set
+ *    before the prompt for a session is run.
+ *
+ * COPYRIGHT:
+ *    Copyright 2022 Paul Hutchinson
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files
+ *    (the "Software"), to deal in the Software without restriction,
+ *    including without limitation the rights to use, copy, modify,
+ *    merge, publish, distribute, sublicense, and/or sell copies of the
+ *    Software, and to permit persons to whom the Software is furnished
+ *    to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included
+ *    in all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ *    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *    SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * CREATED BY:
+ *    Paul Hutchinson (17 Oct 2026)
+ *
+ ******************************************************************************/
+
+/*** HEADER FILES TO INCLUDE  ***/
+#define _GNU_SOURCE                     // For accept4()
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "CLI.h"
+#include "CLI_TelnetServer.h"
+
+/*** DEFINES                  ***/
+#define TELNETSERVER_MAX_SESSIONS               1024
+#define TELNETSERVER_MAX_EVENTS                 64      // How many epoll events we handle per epoll_wait()
+#define TELNETSERVER_RUN_BUDGET                 16      // How many times we run a prompt before moving to the next session
+#define TELNETSERVER_TX_BUFFSIZE                4096    // The starting size of the output we hold for a session when the socket is full
+#define TELNETSERVER_LINE_BUFFSIZE              100
+#define TELNETSERVER_HISTORY_BUFFSIZE           1000
+
+#if !defined(CLI_READ) || !defined(CLI_WRITE) || !defined(CLI_MALLOC)
+ #error The telnet server needs CLI_READ(), CLI_WRITE() and CLI_MALLOC() set in CLI_Options.h
+#endif
+
+/*** MACROS                   ***/
+
+/*** TYPE DEFINITIONS         ***/
+struct TelnetSession
+{
+    int Socket;                                 // The connection (-1 if this session is not in use)
+    struct CLIHandle *Prompt;                   // The prompt for this session (NULL if not in use)
+    bool Drained;                               // Have we read everything the socket had (recv() said EAGAIN)
+    bool Closing;                               // Close this session when we are done running it
+    bool Error;                                 // The socket failed (don't send anything else)
+    bool OnPendingList;                         // Is this session in 'm_PendingList'
+    struct TelnetSession *NextFree;             // Next session in 'm_FreeList' / 'm_ClosedList'
+    struct TelnetSession *NextPending;          // Next session in 'm_PendingList'
+    unsigned int TxLen;                         // The number of bytes in 'TxBuff' (the session isn't run while this is not 0)
+    unsigned int TxSize;                        // The size of 'TxBuff'
+    char *TxBuff;                               // Output waiting for the socket to have room (malloc'ed when needed)
+};
+
+/*** FUNCTION PROTOTYPES      ***/
+static void TelnetServer_Accept(void);
+static void TelnetServer_RunSession(struct TelnetSession *Session);
+static void TelnetServer_CloseSession(struct TelnetSession *Session);
+static void TelnetServer_UpdatePending(struct TelnetSession *Session);
+static void TelnetServer_FlushTx(struct TelnetSession *Session);
+static int TelnetServer_GetTimeout(void);
+
+/*** VARIABLE DEFINITIONS     ***/
+static int m_ListenSocket=-1;
+static int m_EpollFD=-1;
+static struct TelnetSession m_Sessions[TELNETSERVER_MAX_SESSIONS];
+static struct TelnetSession *m_FreeList;        // Sessions ready to be used
+static struct TelnetSession *m_ClosedList;      // Sessions closed during this poll (freed at the end)
+static struct TelnetSession *m_PendingList;     // Sessions that need to be run without waiting for the socket
+static struct TelnetSession *m_CurrentSession;  // The session the HAL functions talk to
+static unsigned int m_SessionCount;
+static char m_PrintfBuff[1000];
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_Init
+ *
+ * SYNOPSIS:
+ *    bool TelnetServer_Init(uint16_t Port);
+ *
+ * PARAMETERS:
+ *    Port [I] -- The TCP port to listen on.
+ *
+ * FUNCTION:
+ *    This function opens the listening socket.  Each connection gets a
+ *    prompt from CLI_GetHandle() and gives it back with CLI_FreeHandle()
+ *    when it closes.
+ *
+ * RETURNS:
+ *    true -- Server is ready to go
+ *    false -- There was an error.
+ *
+ * SEE ALSO:
+ *    TelnetServer_Poll(), TelnetServer_Shutdown()
+ ******************************************************************************/
+bool TelnetServer_Init(uint16_t Port)
+{
+    struct sockaddr_in servaddr;
+    struct epoll_event ev;
+    struct TelnetSession **Last;
+    int opt;
+    int r;
+
+    /* Put all the sessions on the free list */
+    Last=&m_FreeList;
+    for(r=0;r<TELNETSERVER_MAX_SESSIONS;r++)
+    {
+        m_Sessions[r].Socket=-1;
+        m_Sessions[r].TxBuff=NULL;
+        m_Sessions[r].TxSize=0;
+        *Last=&m_Sessions[r];
+        Last=&m_Sessions[r].NextFree;
+    }
+    *Last=NULL;
+
+    m_ListenSocket=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+    if(m_ListenSocket<0)
+        return false;
+
+    opt=1;
+    if(setsockopt(m_ListenSocket,SOL_SOCKET,SO_REUSEADDR|SO_REUSEPORT,&opt,
+            sizeof(opt)))
+    {
+        TelnetServer_Shutdown();
+        return false;
+    }
+
+    memset(&servaddr,0,sizeof(servaddr));
+    servaddr.sin_family=AF_INET;
+    servaddr.sin_addr.s_addr=htonl(INADDR_ANY);
+    servaddr.sin_port=htons(Port);
+
+    if(bind(m_ListenSocket,(struct sockaddr *)&servaddr,sizeof(servaddr))!=0 ||
+            listen(m_ListenSocket,SOMAXCONN)!=0)
+    {
+        TelnetServer_Shutdown();
+        return false;
+    }
+
+    m_EpollFD=epoll_create1(EPOLL_CLOEXEC);
+    if(m_EpollFD<0)
+    {
+        TelnetServer_Shutdown();
+        return false;
+    }
+
+    /* The listen socket is the only one with a NULL session */
+    ev.events=EPOLLIN|EPOLLET;
+    ev.data.ptr=NULL;
+    if(epoll_ctl(m_EpollFD,EPOLL_CTL_ADD,m_ListenSocket,&ev)!=0)
+    {
+        TelnetServer_Shutdown();
+        return false;
+    }
+
+    printf("telnet localhost %d\n",Port);
+
+    return true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_Shutdown
+ *
+ * SYNOPSIS:
+ *    void TelnetServer_Shutdown(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function closes all the sessions and the listening socket.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_Init()
+ ******************************************************************************/
+void TelnetServer_Shutdown(void)
+{
+    int r;
+
+    for(r=0;r<TELNETSERVER_MAX_SESSIONS;r++)
+    {
+        if(m_Sessions[r].Socket>=0)
+            close(m_Sessions[r].Socket);
+        free(m_Sessions[r].TxBuff);
+        m_Sessions[r].TxBuff=NULL;
+        m_Sessions[r].TxSize=0;
+    }
+
+    if(m_EpollFD>=0)
+        close(m_EpollFD);
+    if(m_ListenSocket>=0)
+        close(m_ListenSocket);
+    m_EpollFD=-1;
+    m_ListenSocket=-1;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_Poll
+ *
+ * SYNOPSIS:
+ *    void TelnetServer_Poll(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function waits for something to happen on any of the sockets (or
+ *    for a prompt's ESC timeout) and then handles it.  Call this over and
+ *    over from the main loop.  It blocks, so the main loop does not spin.
+ *
+ *    Because the sockets are edge triggered a session is run until its
+ *    socket says EAGAIN.  To stop one busy session from starving the rest
+ *    it is only run TELNETSERVER_RUN_BUDGET times per event, after that it
+ *    goes on the pending list and gets picked up again next poll.
+ *
+ *    A session that has output waiting for the socket is not run again
+ *    until EPOLLOUT says there is room and all the output has gone out.  A
+ *    slow client (or one that isn't reading) just stops its own session,
+ *    no output is thrown away.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_Init()
+ ******************************************************************************/
+void TelnetServer_Poll(void)
+{
+    struct epoll_event Events[TELNETSERVER_MAX_EVENTS];
+    struct TelnetSession *Session;
+    struct TelnetSession *Pending;
+    int Count;
+    int r;
+
+    Count=epoll_wait(m_EpollFD,Events,TELNETSERVER_MAX_EVENTS,
+            TelnetServer_GetTimeout());
+
+    for(r=0;r<Count;r++)
+    {
+        Session=Events[r].data.ptr;
+        if(Session==NULL)
+        {
+            TelnetServer_Accept();
+            continue;
+        }
+
+        /* Closed by an earlier event in this batch */
+        if(Session->Socket<0)
+            continue;
+
+        if(Events[r].events&EPOLLOUT)
+            TelnetServer_FlushTx(Session);
+
+        if(Events[r].events&(EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))
+            Session->Drained=false;
+
+        /* Run it if it has new input, or it was stopped for its output and
+           that has all gone out now */
+        TelnetServer_RunSession(Session);
+    }
+
+    /* Run anything that still has input or an ESC that has timed out */
+    Pending=m_PendingList;
+    m_PendingList=NULL;
+    while(Pending!=NULL)
+    {
+        Session=Pending;
+        Pending=Session->NextPending;
+        Session->OnPendingList=false;
+
+        if(Session->Socket<0)
+            continue;
+
+        if(!Session->Drained || CLI_GetNextWakeup(Session->Prompt)==0)
+            TelnetServer_RunSession(Session);
+        else
+            TelnetServer_UpdatePending(Session);
+    }
+
+    /* Now it is safe to reuse the sessions we closed (no more events
+       for them are in 'Events') */
+    while(m_ClosedList!=NULL)
+    {
+        Session=m_ClosedList;
+        m_ClosedList=Session->NextFree;
+        Session->NextFree=m_FreeList;
+        m_FreeList=Session;
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_CloseCurrentSession
+ *
+ * SYNOPSIS:
+ *    void TelnetServer_CloseCurrentSession(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function closes the session that is running the current command.
+ *    The socket is closed when the command returns.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *
+ ******************************************************************************/
+void TelnetServer_CloseCurrentSession(void)
+{
+    if(m_CurrentSession!=NULL)
+        m_CurrentSession->Closing=true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_GetSessionCount
+ *
+ * SYNOPSIS:
+ *    unsigned int TelnetServer_GetSessionCount(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function gets the number of sessions that are connected.
+ *
+ * RETURNS:
+ *    The number of open sessions.
+ *
+ * SEE ALSO:
+ *
+ ******************************************************************************/
+unsigned int TelnetServer_GetSessionCount(void)
+{
+    return m_SessionCount;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_Accept
+ *
+ * SYNOPSIS:
+ *    static void TelnetServer_Accept(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function accepts all the new connections that are waiting and
+ *    gives each one a session.  If we are out of sessions the connection is
+ *    told so and closed.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_Poll()
+ ******************************************************************************/
+static void TelnetServer_Accept(void)
+{
+    struct TelnetSession *Session;
+    struct epoll_event ev;
+    struct CLIHandle *Prompt;
+    int NewSocket;
+    int opt;
+
+    /* Edge triggered, so take everything that is waiting */
+    for(;;)
+    {
+        NewSocket=accept4(m_ListenSocket,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if(NewSocket<0)
+        {
+            if(errno==EINTR || errno==ECONNABORTED)
+                continue;
+            /* EAGAIN (we are done) or out of fd's */
+            return;
+        }
+
+        Session=m_FreeList;
+        Prompt=NULL;
+        if(Session!=NULL)
+            Prompt=CLI_GetHandle();
+        if(Prompt!=NULL)
+        {
+            CLI_InitPrompt(Prompt);
+            if(!CLI_AllocBuffers(Prompt,TELNETSERVER_LINE_BUFFSIZE,
+                    TELNETSERVER_HISTORY_BUFFSIZE))
+            {
+                CLI_FreeHandle(Prompt);
+                Prompt=NULL;
+            }
+            else
+            {
+                /* Telnet clients understand ANSI */
+                CLI_SetANSIMode(Prompt,true);
+            }
+        }
+        if(Prompt==NULL)
+        {
+            send(NewSocket,"Too many sessions\r\n",19,MSG_NOSIGNAL);
+            close(NewSocket);
+            continue;
+        }
+
+        /* We always send whole chunks so don't wait to fill packets */
+        opt=1;
+        setsockopt(NewSocket,IPPROTO_TCP,TCP_NODELAY,&opt,sizeof(opt));
+
+        /* We never change the events, EPOLLOUT only fires (once) when the
+           socket goes from full to having room */
+        ev.events=EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+        ev.data.ptr=Session;
+        if(epoll_ctl(m_EpollFD,EPOLL_CTL_ADD,NewSocket,&ev)!=0)
+        {
+            CLI_FreeHandle(Prompt);
+            close(NewSocket);
+            continue;
+        }
+
+        m_FreeList=Session->NextFree;
+        m_SessionCount++;
+
+        Session->Socket=NewSocket;
+        Session->Prompt=Prompt;
+        Session->Drained=false;
+        Session->Closing=false;
+        Session->Error=false;
+        Session->TxLen=0;
+
+        m_CurrentSession=Session;
+
+        CLI_SendTelnetInitConnectionMsg(Session->Prompt);
+
+        /* Send out a banner */
+        cprintf("Welcome to MyCLI (session %d)\r\n",
+                (int)(Session-m_Sessions));
+        CLI_DrawPrompt(Session->Prompt);
+
+        m_CurrentSession=NULL;
+
+        /* The client may have sent something already */
+        TelnetServer_UpdatePending(Session);
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_RunSession
+ *
+ * SYNOPSIS:
+ *    static void TelnetServer_RunSession(struct TelnetSession *Session);
+ *
+ * PARAMETERS:
+ *    Session [I] -- The session to run
+ *
+ * FUNCTION:
+ *    This function runs the prompt for a session until it has used up all
+ *    the input on the socket (or its budget).  It stops early if some of
+ *    the output didn't fit in the socket (the EPOLLOUT event runs it again
+ *    when it has all been sent).  The session is closed if the connection
+ *    went away (or the command asked for it).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_Poll()
+ ******************************************************************************/
+static void TelnetServer_RunSession(struct TelnetSession *Session)
+{
+    unsigned int Runs;
+
+    m_CurrentSession=Session;
+
+    Runs=0;
+    while(!Session->Closing && Session->TxLen==0 &&
+            Runs<TELNETSERVER_RUN_BUDGET && (!Session->Drained || CLI_GetNextWakeup(Session->Prompt)==0))
+    {
+        CLI_RunCmdPrompt(Session->Prompt);
+        Runs++;
+    }
+
+    m_CurrentSession=NULL;
+
+    if(Session->Closing)
+        TelnetServer_CloseSession(Session);
+    else
+        TelnetServer_UpdatePending(Session);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_CloseSession
+ *
+ * SYNOPSIS:
+ *    static void TelnetServer_CloseSession(struct TelnetSession *Session);
+ *
+ * PARAMETERS:
+ *    Session [I] -- The session to close
+ *
+ * FUNCTION:
+ *    This function frees the prompt for a session, closes its socket, and
+ *    queues the session to be reused at the end of this poll.  The prompt
+ *    is freed first (as the current session) so what it sends to put the
+ *    terminal back goes out, then we try one last time to send the output
+ *    that is waiting.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_Poll()
+ ******************************************************************************/
+static void TelnetServer_CloseSession(struct TelnetSession *Session)
+{
+    m_CurrentSession=Session;
+    CLI_FreeHandle(Session->Prompt);
+    Session->Prompt=NULL;
+    m_CurrentSession=NULL;
+
+    if(!Session->Error)
+        TelnetServer_FlushTx(Session);
+
+    /* Closing the socket also takes it out of epoll */
+    close(Session->Socket);
+    Session->Socket=-1;
+    Session->TxLen=0;
+    free(Session->TxBuff);
+    Session->TxBuff=NULL;
+    Session->TxSize=0;
+
+    Session->NextFree=m_ClosedList;
+    m_ClosedList=Session;
+    m_SessionCount--;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_UpdatePending
+ *
+ * SYNOPSIS:
+ *    static void TelnetServer_UpdatePending(struct TelnetSession *Session);
+ *
+ * PARAMETERS:
+ *    Session [I] -- The session to check
+ *
+ * FUNCTION:
+ *    This function adds a session to the pending list if it needs to be run
+ *    again without waiting for the socket.  That is when we stopped before
+ *    reading everything from the socket, or the prompt is timing an ESC.
+ *    Sessions with output waiting are left off (EPOLLOUT picks them up).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    TelnetServer_GetTimeout()
+ ******************************************************************************/
+static void TelnetServer_UpdatePending(struct TelnetSession *Session)
+{
+    if(Session->OnPendingList || Session->TxLen>0)
+        return;
+
+    if(Session->Drained &&
+            CLI_GetNextWakeup(Session->Prompt)==CLI_WAIT_FOREVER)
+    {
+        return;
+    }
+
+    Session->NextPending=m_PendingList;
+    m_PendingList=Session;
+    Session->OnPendingList=true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_GetTimeout
+ *
+ * SYNOPSIS:
+ *    static int TelnetServer_GetTimeout(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function works out how long epoll_wait() can sleep for.  Only the
+ *    sessions on the pending list are looked at, so this does not grow
+ *    with the number of sessions.
+ *
+ * RETURNS:
+ *    The timeout in ms for epoll_wait() (-1 for forever)
+ *
+ * SEE ALSO:
+ *    TelnetServer_UpdatePending()
+ ******************************************************************************/
+static int TelnetServer_GetTimeout(void)
+{
+    struct TelnetSession *Session;
+    uint32_t Timeout;
+    uint32_t Wakeup;
+
+    Timeout=CLI_WAIT_FOREVER;
+    for(Session=m_PendingList;Session!=NULL;Session=Session->NextPending)
+    {
+        if(!Session->Drained)
+            return 0;
+
+        Wakeup=CLI_GetNextWakeup(Session->Prompt);
+        if(Wakeup<Timeout)
+            Timeout=Wakeup;
+    }
+
+    if(Timeout==CLI_WAIT_FOREVER)
+        return -1;
+    return (int)Timeout;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    TelnetServer_FlushTx
+ *
+ * SYNOPSIS:
+ *    static void TelnetServer_FlushTx(struct TelnetSession *Session);
+ *
+ * PARAMETERS:
+ *    Session [I] -- The session to send the waiting output for
+ *
+ * FUNCTION:
+ *    This function sends as much of the waiting output for a session as
+ *    the socket will take.  If the socket failed the session is marked to
+ *    be closed (and nothing else is sent).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    HAL_CLI_Write()
+ ******************************************************************************/
+static void TelnetServer_FlushTx(struct TelnetSession *Session)
+{
+    ssize_t Sent;
+
+    if(Session->TxLen==0)
+        return;
+
+    do
+    {
+        Sent=send(Session->Socket,Session->TxBuff,Session->TxLen,
+                MSG_NOSIGNAL);
+    } while(Sent<0 && errno==EINTR);
+    if(Sent<0)
+    {
+        if(errno!=EAGAIN && errno!=EWOULDBLOCK)
+        {
+            Session->Error=true;
+            Session->Closing=true;
+        }
+        return;
+    }
+
+    Session->TxLen-=Sent;
+    memmove(Session->TxBuff,&Session->TxBuff[Sent],Session->TxLen);
+
+    /* Don't hang on to a buffer that grew for one big command */
+    if(Session->TxLen==0 && Session->TxSize>TELNETSERVER_TX_BUFFSIZE)
+    {
+        free(Session->TxBuff);
+        Session->TxBuff=NULL;
+        Session->TxSize=0;
+    }
+}
+
+int HAL_CLI_Read(char *Buff,int MaxBytes)
+{
+    struct TelnetSession *Session=m_CurrentSession;
+    ssize_t bytes;
+
+    if(Session==NULL || Session->Closing || Session->Drained)
+        return 0;
+
+    bytes=recv(Session->Socket,Buff,MaxBytes,0);
+    if(bytes>0)
+    {
+        /* A short read on a stream socket means we emptied it */
+        if(bytes<MaxBytes)
+            Session->Drained=true;
+        return bytes;
+    }
+
+    if(bytes<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+    {
+        Session->Drained=true;
+    }
+    else if(bytes<0 && errno==EINTR)
+    {
+        /* Try again next time */
+    }
+    else
+    {
+        /* 0=connection closed (they may still read what we send) */
+        Session->Drained=true;
+        Session->Closing=true;
+        if(bytes<0)
+            Session->Error=true;
+    }
+    return 0;
+}
+
+void HAL_CLI_Write(const char *Buff,int Bytes)
+{
+    struct TelnetSession *Session=m_CurrentSession;
+    ssize_t Sent;
+    unsigned int NewSize;
+    char *NewBuff;
+
+    /* Keep sending after a command asks to close, the rest of its output
+       (and the prompt putting the terminal back) still has to go out */
+    if(Session==NULL || Session->Error)
+        return;
+
+    /* If nothing is waiting try to send it right away */
+    if(Session->TxLen==0)
+    {
+        do
+        {
+            Sent=send(Session->Socket,Buff,Bytes,MSG_NOSIGNAL);
+        } while(Sent<0 && errno==EINTR);
+        if(Sent<0)
+        {
+            if(errno!=EAGAIN && errno!=EWOULDBLOCK)
+            {
+                Session->Error=true;
+                Session->Closing=true;
+                return;
+            }
+            Sent=0;
+        }
+        Buff+=Sent;
+        Bytes-=Sent;
+    }
+
+    if(Bytes==0)
+        return;
+
+    /* Keep what didn't fit for EPOLLOUT.  The session isn't run again until
+       it has all gone out, so this only grows past TELNETSERVER_TX_BUFFSIZE
+       when one command prints more than that. */
+    if(Session->TxLen+Bytes>Session->TxSize)
+    {
+        NewSize=Session->TxSize;
+        if(NewSize==0)
+            NewSize=TELNETSERVER_TX_BUFFSIZE;
+        while(NewSize<Session->TxLen+Bytes)
+            NewSize*=2;
+        NewBuff=realloc(Session->TxBuff,NewSize);
+        if(NewBuff==NULL)
+        {
+            /* We can't hold it, close the session instead of sending
+               part of the output */
+            Session->Error=true;
+            Session->Closing=true;
+            return;
+        }
+        Session->TxBuff=NewBuff;
+        Session->TxSize=NewSize;
+    }
+    memcpy(&Session->TxBuff[Session->TxLen],Buff,Bytes);
+    Session->TxLen+=Bytes;
+}
+
+void HAL_CLI_PutChar(char c)
+{
+    HAL_CLI_Write(&c,1);
+}
+
+uint32_t HAL_CLI_GetMilliSecCounter(void)
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC,&Now);
+
+    return Now.tv_sec*1000+Now.tv_nsec/1000000;
+}
+
+int cprintf(const char *fmt,...)
+{
+    va_list args;
+    int RetValue;
+
+    va_start(args,fmt);
+
+    RetValue=vsnprintf(m_PrintfBuff,sizeof(m_PrintfBuff),fmt,args);
+
+    va_end(args);
+
+    if(RetValue>=(int)sizeof(m_PrintfBuff))
+        RetValue=sizeof(m_PrintfBuff)-1;
+    if(RetValue>0)
+        HAL_CLI_Write(m_PrintfBuff,RetValue);
+
+    return RetValue;
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * FILENAME: CLI_TelnetServer.h
+ *
+ * PROJECT:
+ *    MyCLI
+ *
+ * FILE DESCRIPTION:
+ *    This is the .h file for the CLI_TelnetServer.c file.
+ *
+ * COPYRIGHT:
+ *    Copyright 2022 Paul Hutchinson
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files
+ *    (the "Software"), to deal in the Software without restriction,
+ *    including without limitation the rights to use, copy, modify,
+ *    merge, publish, distribute, sublicense, and/or sell copies of the
+ *    Software, and to permit persons to whom the Software is furnished
+ *    to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included
+ *    in all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ *    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *    SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * HISTORY:
+ *    Paul Hutchinson (17 Oct 2026)
+ *       Created
+ *
+ *******************************************************************************/
+#ifndef __CLI_TELNETSERVER_H_
+#define __CLI_TELNETSERVER_H_
+
+/***  HEADER FILES TO INCLUDE          ***/
+#include <stdbool.h>
+#include <stdint.h>
+
+/***  DEFINES                          ***/
+
+/***  MACROS                           ***/
+
+/***  TYPE DEFINITIONS                 ***/
+
+/***  CLASS DEFINITIONS                ***/
+
+/***  GLOBAL VARIABLE DEFINITIONS      ***/
+
+/***  EXTERNAL FUNCTION PROTOTYPES     ***/
+bool TelnetServer_Init(uint16_t Port);
+void TelnetServer_Shutdown(void);
+void TelnetServer_Poll(void);
+void TelnetServer_CloseCurrentSession(void);
+unsigned int TelnetServer_GetSessionCount(void);
+int cprintf(const char *fmt,...);
+
+#endif
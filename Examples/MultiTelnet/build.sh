@@ -0,0 +1,3 @@
+#!/bin/sh
+
+gcc -Wall -I ../../src -I . main.c CLI_TelnetServer.c ../../src/Full/CLI.c -g -o a.out
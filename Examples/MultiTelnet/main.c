@@ -0,0 +1,63 @@
+#include "CLI.h"
+#include "CLI_Options.h"
+#include "CLI_TelnetServer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TELNET_PORT                             2323
+
+int quit=false;
+
+void quitfn(int argc,const char **argv);
+void helpfn(int argc,const char **argv);
+void exitfn(int argc,const char **argv);
+void whofn(int argc,const char **argv);
+
+const struct CLICommand g_CLICmds[]=
+{
+    {"Quit","Quit the program (for everyone)",quitfn},
+    {"Help","Get help",helpfn},
+    {"Exit","Exit this telnet session",exitfn},
+    {"Who","Show how many sessions are connected",whofn},
+};
+
+unsigned int g_CLICmdsCount=sizeof(g_CLICmds)/sizeof(struct CLICommand);
+
+int main(void)
+{
+    if(!TelnetServer_Init(TELNET_PORT))
+    {
+        printf("Failed in to init telnet server\n");
+        return 1;
+    }
+
+    while(!quit)
+        TelnetServer_Poll();
+
+    TelnetServer_Shutdown();
+
+    return 0;
+}
+
+void quitfn(int argc,const char **argv)
+{
+    quit=true;
+}
+
+void helpfn(int argc,const char **argv)
+{
+    CLI_DisplayHelp();
+}
+
+void exitfn(int argc,const char **argv)
+{
+    TelnetServer_CloseCurrentSession();
+}
+
+void whofn(int argc,const char **argv)
+{
+    cprintf("%u session(s) connected\r\n",TelnetServer_GetSessionCount());
+}
@@ -224,6 +224,34 @@ void TelnetSocketTick(void)
     }
 }
 
+/*******************************************************************************
+ * NAME:
+ *    TelnetSocket_GetWaitFD
+ *
+ * SYNOPSIS:
+ *    int TelnetSocket_GetWaitFD(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function gets the socket that should be waited on (with poll())
+ *    for telnet.  This is the connection if we have one, or the listening
+ *    socket if we are waiting for someone to connect.
+ *
+ * RETURNS:
+ *    The socket to wait on or -1 if there isn't one.
+ *
+ * SEE ALSO:
+ *    TelnetSocketTick()
+ ******************************************************************************/
+int TelnetSocket_GetWaitFD(void)
+{
+    if(m_TelnetConnectionSocket>=0)
+        return m_TelnetConnectionSocket;
+    return m_TelnetListenSocket;
+}
+
 bool TelnetSocket_IsCharAvailable(void)
 {
     struct timeval tv = { 0L, 0L };
@@ -276,6 +304,30 @@ void TelnetSocket_PutChar(char c)
     write(m_TelnetConnectionSocket,&c,1);
 }
 
+void TelnetSocket_Write(const char *Buff,int Bytes)
+{
+    int Start;
+    int r;
+
+    if(m_TelnetConnectionSocket<0)
+        return;
+
+    /* Send it in runs, adding a \r in front of every \n */
+    Start=0;
+    for(r=0;r<Bytes;r++)
+    {
+        if(Buff[r]=='\n')
+        {
+            if(r>Start)
+                write(m_TelnetConnectionSocket,&Buff[Start],r-Start);
+            write(m_TelnetConnectionSocket,"\r\n",2);
+            Start=r+1;
+        }
+    }
+    if(Bytes>Start)
+        write(m_TelnetConnectionSocket,&Buff[Start],Bytes-Start);
+}
+
 void TelnetSocket_CloseConnection(void)
 {
     if(m_TelnetConnectionSocket<0)
@@ -54,9 +54,11 @@
 bool InitTelnetSocket(void);
 void ShutdownTelnetSocket(void);
 void TelnetSocketTick(void);
+int TelnetSocket_GetWaitFD(void);
 bool TelnetSocket_IsCharAvailable(void);
 char TelnetSocket_GetChar(void);
 void TelnetSocket_PutChar(char c);
+void TelnetSocket_Write(const char *Buff,int Bytes);
 void TelnetSocket_CloseConnection(void);
 
 #endif
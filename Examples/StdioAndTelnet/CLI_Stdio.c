@@ -102,3 +102,9 @@ void Stdio_PutChar(char c)
     putchar(c);
     fflush(stdout);
 }
+
+void Stdio_Write(const char *Buff,int Bytes)
+{
+    fwrite(Buff,1,Bytes,stdout);
+    fflush(stdout);
+}
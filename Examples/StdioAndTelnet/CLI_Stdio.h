@@ -56,5 +56,6 @@ void ShutDownIO(void);
 bool Stdio_IsCharAvailable(void);
 char Stdio_GetChar(void);
 void Stdio_PutChar(char c);
+void Stdio_Write(const char *Buff,int Bytes);
 
 #endif
@@ -3,6 +3,7 @@
 #include "CLI_Sockets.h"
 #include "CLI_Stdio.h"
 #include <sys/time.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -61,6 +62,8 @@ int main(void)
     CLI_DrawPrompt(g_Prompt);
     while(!quit)
     {
+        /* Sleep until there is input or a new telnet connection */
+        CLI_WaitForInput(g_Prompt,CLI_WAIT_FOREVER);
         CLI_RunCmdPrompt(g_Prompt);
         TelnetSocketTick();
     }
@@ -188,7 +191,6 @@ int cprintf(const char *fmt,...)
 {
     va_list args;
     int RetValue;
-    int r;
 
     va_start(args,fmt);
 
@@ -196,8 +198,7 @@ int cprintf(const char *fmt,...)
 
     va_end(args);
 
-    for(r=0;r<RetValue;r++)
-        HAL_CLI_PutChar(m_PrintfBuff[r]);
+    HAL_CLI_Write(m_PrintfBuff,RetValue);
 
     return RetValue;
 }
@@ -228,6 +229,19 @@ char HAL_CLI_GetChar(void)
         return Stdio_GetChar();
 }
 
+bool HAL_CLI_WaitForInput(uint32_t Timeout)
+{
+    struct pollfd fds[2];
+
+    /* stdin is ignored while telnet has the prompt (poll() skips -1) */
+    fds[0].fd=m_UseTelnet?-1:0;
+    fds[0].events=POLLIN;
+    fds[1].fd=TelnetSocket_GetWaitFD();
+    fds[1].events=POLLIN;
+
+    return poll(fds,2,Timeout==CLI_WAIT_FOREVER?-1:(int)Timeout)>0;
+}
+
 void HAL_CLI_PutChar(char c)
 {
     if(m_UseTelnet)
@@ -236,3 +250,11 @@ void HAL_CLI_PutChar(char c)
         Stdio_PutChar(c);
 }
 
+void HAL_CLI_Write(const char *Buff,int Bytes)
+{
+    if(m_UseTelnet)
+        TelnetSocket_Write(Buff,Bytes);
+    else
+        Stdio_Write(Buff,Bytes);
+}
+
@@ -36,6 +36,7 @@
 
 /*** HEADER FILES TO INCLUDE  ***/
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
@@ -268,6 +269,47 @@ char HAL_CLI_GetChar(void)
     return c;
 }
 
+int HAL_CLI_Read(char *Buff,int MaxBytes)
+{
+    int bytes;
+
+    if(m_TelnetConnectionSocket<0)
+        return 0;
+
+    /* Telnet (take everything that is waiting in one read) */
+    bytes=recv(m_TelnetConnectionSocket,Buff,MaxBytes,MSG_DONTWAIT);
+    if(bytes<0)
+    {
+        /* Nothing ready (EAGAIN) or an error */
+        bytes=0;
+    }
+    else if(bytes==0)
+    {
+        /* 0=connection closed */
+        close(m_TelnetConnectionSocket);
+        m_TelnetConnectionSocket=-1;
+    }
+    return bytes;
+}
+
+bool HAL_CLI_WaitForInput(uint32_t Timeout)
+{
+    struct pollfd fds;
+
+    if(m_TelnetListenSocket<0)
+        return false;
+
+    /* Wait on the connection, or for a new connection if we don't have one
+       (so TelnetSocketTick() gets run when someone connects) */
+    if(m_TelnetConnectionSocket>=0)
+        fds.fd=m_TelnetConnectionSocket;
+    else
+        fds.fd=m_TelnetListenSocket;
+    fds.events=POLLIN;
+
+    return poll(&fds,1,Timeout==CLI_WAIT_FOREVER?-1:(int)Timeout)>0;
+}
+
 void HAL_CLI_PutChar(char c)
 {
     if(m_TelnetConnectionSocket<0)
@@ -276,6 +318,14 @@ void HAL_CLI_PutChar(char c)
     write(m_TelnetConnectionSocket,&c,1);
 }
 
+void HAL_CLI_Write(const char *Buff,int Bytes)
+{
+    if(m_TelnetConnectionSocket<0)
+        return;
+
+    write(m_TelnetConnectionSocket,Buff,Bytes);
+}
+
 uint32_t HAL_CLI_GetMilliSecCounter(void)
 {
     struct timeval start;
@@ -39,6 +39,9 @@ int main(void)
     CLI_InitPrompt(g_Prompt);
     CLI_SetLineBuffer(g_Prompt,g_LineBuff,100);
     CLI_SetHistoryBuffer(g_Prompt,g_HistoryBuff,100);
+
+    /* Telnet clients understand ANSI, so only send what changes */
+    CLI_SetANSIMode(g_Prompt,true);
 
     if(!InitTelnetSocket())
     {
@@ -48,6 +51,8 @@ int main(void)
 
     while(!quit)
     {
+        /* Sleep until there is input or a new connection */
+        CLI_WaitForInput(g_Prompt,CLI_WAIT_FOREVER);
         CLI_RunCmdPrompt(g_Prompt);
         TelnetSocketTick();
     }
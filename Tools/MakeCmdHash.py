@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+################################################################################
+# FILENAME: MakeCmdHash.py
+#
+# PROJECT:
+#    MyCLI
+#
+# FILE DESCRIPTION:
+#    This tool reads the g_CLICmds[] table from a C file and makes a .h file
+#    with a minimal perfect hash of the command names in it (hash and
+#    displace).  The tables in the .h are const so they live in flash and
+#    CLI_RunLine() can find a command with one hash and one compare without
+#    using any RAM.
+#
+#    Usage:
+#       python3 MakeCmdHash.py main.c CLI_CmdHash.h
+#
+#    Then add this to your CLI_Options.h:
+#       #define CLI_CMD_PERFECT_HASH            "CLI_CmdHash.h"
+#
+#    The .h must be made again any time a command is added, removed,
+#    renamed or moved in g_CLICmds[].  The .h has a hash of the command
+#    names (in order) and if it does not match g_CLICmds[] when a prompt is
+#    init'ed the CLI falls back to checking each command in turn.
+#
+# COPYRIGHT:
+#    Copyright 2022 Paul Hutchinson
+#
+#    Permission is hereby granted, free of charge, to any person obtaining
+#    a copy of this software and associated documentation files
+#    (the "Software"), to deal in the Software without restriction,
+#    including without limitation the rights to use, copy, modify,
+#    merge, publish, distribute, sublicense, and/or sell copies of the
+#    Software, and to permit persons to whom the Software is furnished
+#    to do so, subject to the following conditions:
+#
+#    The above copyright notice and this permission notice shall be included
+#    in all copies or substantial portions of the Software.
+#
+#    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+#    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+#    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+#    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+#    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+#    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+#    SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+# CREATED BY:
+#    Paul Hutchinson (17 Oct 2026)
+#
+################################################################################
+import os
+import re
+import sys
+
+MAX_DISP=0xFFFF
+
+################################################################################
+# Must match CLI_HashCmd() in CLI.c (FNV-1a, A-Z hashed as a-z)
+################################################################################
+def HashCmd(Name):
+    Hash=2166136261
+    for c in Name.encode("latin-1"):
+        if c>=ord('A') and c<=ord('Z'):
+            c+=ord('a')-ord('A')
+        Hash^=c
+        Hash=(Hash*16777619)&0xFFFFFFFF
+    return Hash
+
+################################################################################
+# Must match CLI_MixCmdHash() in CLI.c (the murmur3 32 bit finalizer)
+################################################################################
+def MixCmdHash(Hash):
+    Hash^=Hash>>16
+    Hash=(Hash*0x85EBCA6B)&0xFFFFFFFF
+    Hash^=Hash>>13
+    Hash=(Hash*0xC2B2AE35)&0xFFFFFFFF
+    Hash^=Hash>>16
+    return Hash
+
+################################################################################
+# Must match CLI_CheckCmdPHash() in CLI.c (FNV-1a of each name and its \0 in
+# order)
+################################################################################
+def NamesHash(Cmds):
+    Hash=2166136261
+    for Name in Cmds:
+        for c in Name.encode("latin-1")+b"\0":
+            Hash^=c
+            Hash=(Hash*16777619)&0xFFFFFFFF
+    return Hash
+
+################################################################################
+# Pull the command names out of the g_CLICmds[] table in a C file
+################################################################################
+def ReadCmds(Filename):
+    with open(Filename,encoding="latin-1") as f:
+        Src=f.read()
+
+    # Remove comments (keeping strings)
+    Src=re.sub(r'//[^\n]*|/\*.*?\*/|("(?:\\.|[^"\\])*")',
+            lambda m:m.group(1) if m.group(1) else " ",Src,flags=re.S)
+
+    m=re.search(r'\bg_CLICmds\s*\[\s*\]\s*=\s*\{',Src)
+    if m is None:
+        raise Exception("Could not find the g_CLICmds[] table in "+Filename)
+
+    Cmds=[]
+    Depth=1
+    Pos=m.end()
+    while Depth>0:
+        if Pos>=len(Src):
+            raise Exception("The end of the g_CLICmds[] table is missing")
+        c=Src[Pos]
+        if c=='"':
+            s=re.match(r'"((?:\\.|[^"\\])*)"',Src[Pos:])
+            if Depth==2 and NeedName:
+                Cmds.append(bytes(s.group(1),"latin-1").decode(
+                        "unicode_escape"))
+                NeedName=False
+            Pos+=s.end()
+            continue
+        if c=='{':
+            Depth+=1
+            if Depth==2:
+                NeedName=True
+        elif c=='}':
+            Depth-=1
+        Pos+=1
+    return Cmds
+
+################################################################################
+# Build the hash and displace tables.  Each command hashes to a bucket, then
+# the displacement for that bucket is searched for so that all the commands
+# in the bucket land in free slots.
+################################################################################
+def MakeTables(Cmds,BucketCount):
+    Count=len(Cmds)
+    Hashes=[HashCmd(c) for c in Cmds]
+    Buckets=[[] for b in range(BucketCount)]
+    for r in range(Count):
+        Buckets[Hashes[r]%BucketCount].append(r)
+
+    Disp=[0]*BucketCount
+    Index=[None]*Count
+    # Do the biggest buckets first while there are lots of free slots
+    for b in sorted(range(BucketCount),key=lambda b:-len(Buckets[b])):
+        if len(Buckets[b])==0:
+            break
+        for d in range(MAX_DISP+1):
+            Slots=[MixCmdHash(Hashes[r]^d)%Count for r in Buckets[b]]
+            if len(set(Slots))==len(Slots) and \
+                    all(Index[s] is None for s in Slots):
+                break
+        else:
+            return None
+        Disp[b]=d
+        for r,s in zip(Buckets[b],Slots):
+            Index[s]=r
+    return Disp,Index
+
+def CType(MaxValue):
+    if MaxValue<=0xFF:
+        return "uint8_t"
+    return "uint16_t"
+
+def FormatArray(Values):
+    Lines=[]
+    for r in range(0,len(Values),12):
+        Lines.append("    "+",".join("%d"%v for v in Values[r:r+12]))
+    return ",\n".join(Lines)
+
+def main():
+    if len(sys.argv)!=3:
+        print("Usage: %s <file with g_CLICmds[]> <output .h>"%sys.argv[0])
+        return 1
+
+    try:
+        Cmds=ReadCmds(sys.argv[1])
+    except Exception as e:
+        print("Error: %s"%e)
+        return 1
+
+    if len(Cmds)==0:
+        print("Error: g_CLICmds[] is empty")
+        return 1
+    if len(Cmds)>0xFFFF:
+        print("Error: Too many commands")
+        return 1
+
+    Seen={}
+    for c in Cmds:
+        if c=="" or " " in c:
+            print("Error: Command \"%s\" can not be hashed (it is empty or "
+                    "has a space in it)"%c)
+            return 1
+        if HashCmd(c) in Seen:
+            print("Error: Commands \"%s\" and \"%s\" have the same hash "
+                    "(commands can not just differ by case)"%(Seen[HashCmd(c)],
+                    c))
+            return 1
+        Seen[HashCmd(c)]=c
+
+    BucketCount=(len(Cmds)+3)//4
+    Tables=None
+    while Tables is None:
+        Tables=MakeTables(Cmds,BucketCount)
+        if Tables is None:
+            BucketCount+=(BucketCount+3)//4
+    Disp,Index=Tables
+
+    Guard="__"+re.sub(r'[^A-Z0-9]','_',
+            os.path.basename(sys.argv[2]).upper())+"_"
+    with open(sys.argv[2],"w") as f:
+        f.write("/* Made by MakeCmdHash.py from %s.  Do not edit, run "
+                "MakeCmdHash.py again\n   when g_CLICmds[] changes. */\n"%
+                os.path.basename(sys.argv[1]))
+        f.write("#ifndef %s\n#define %s\n\n"%(Guard,Guard))
+        f.write("#include <stdint.h>\n\n")
+        f.write("#define CLI_CMDPHASH_COUNT              %d\n"%len(Cmds))
+        f.write("#define CLI_CMDPHASH_BUCKETS            %d\n"%BucketCount)
+        f.write("#define CLI_CMDPHASH_NAMES_HASH         0x%08XU\n\n"%
+                NamesHash(Cmds))
+        f.write("/* Displacement for each bucket */\n")
+        f.write("static const %s g_CLICmdPHashDisp[CLI_CMDPHASH_BUCKETS]=\n"
+                "{\n%s\n};\n\n"%(CType(max(Disp)),FormatArray(Disp)))
+        f.write("/* Index into g_CLICmds[] for each slot */\n")
+        f.write("static const %s g_CLICmdPHashIndex[CLI_CMDPHASH_COUNT]=\n"
+                "{\n%s\n};\n\n"%(CType(len(Cmds)-1),FormatArray(Index)))
+        f.write("#endif\n")
+
+    print("%d commands, %d buckets"%(len(Cmds),BucketCount))
+    return 0
+
+if __name__=="__main__":
+    sys.exit(main())
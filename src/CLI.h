@@ -41,19 +41,33 @@
 #include "CLI_Options.h"    // User provided, has the options for the CLI lib
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /***  DEFINES                          ***/
+#define CLI_WAIT_FOREVER                0xFFFFFFFF      // No timeout for CLI_WaitForInput() / nothing pending from CLI_GetNextWakeup()
 
 /***  MACROS                           ***/
 
 /***  TYPE DEFINITIONS                 ***/
 struct CLIHandle;   // Private struct
 
+typedef enum
+{
+    e_CLIArg_String=0,      // Anything (the default)
+    e_CLIArg_Int,           // A decimal number (with an optional - or +)
+    e_CLIArg_Hex,           // A hex number (with an optional 0x)
+    e_CLIArg_Option,        // One of the CLI_CmdHelp_OptionString()'s for the arg
+    e_CLIArgMAX
+} e_CLIArgType;
+
 struct CLICommand
 {
     const char *Cmd;
     const char *Help;
     void (*Exec)(int argc,const char **argv);
+#ifdef CLI_TYPED_ARGS
+    bool TypedArgs;         // Check the args with the help block before running (see CLI_GetArgValue())
+#endif
 };
 
 /***  CLASS DEFINITIONS                ***/
@@ -64,18 +78,30 @@ extern const struct CLICommand g_CLICmds[]; // The commands we are using
 
 /***  EXTERNAL FUNCTION PROTOTYPES     ***/
 struct CLIHandle *CLI_GetHandle(void);
+void CLI_FreeHandle(struct CLIHandle *Handle);
 void CLI_InitPrompt(struct CLIHandle *Handle);
 char *CLI_GetLine(struct CLIHandle *Handle);
 void CLI_SetLineBuffer(struct CLIHandle *Handle,char *LineBuff,int MaxSize);
 void CLI_SetHistoryBuffer(struct CLIHandle *Handle,char *HistoryBuff,
         int MaxSize);
+void CLI_AddHistoryEntry(struct CLIHandle *Handle,const char *Line);
+#ifdef CLI_MALLOC
+ bool CLI_AllocBuffers(struct CLIHandle *Handle,unsigned int LineSize,
+        unsigned int HistorySize);
+#endif
 void CLI_SetPasswordMode(struct CLIHandle *Handle,bool OnOff);
+void CLI_SetANSIMode(struct CLIHandle *Handle,bool OnOff);
+void CLI_SetTermWidth(struct CLIHandle *Handle,unsigned int Width);
 void CLI_DrawPrompt(struct CLIHandle *Handle);
 void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt);
 void CLI_RunCmdPrompt(struct CLIHandle *Handle);
 void CLI_DisplayHelp(void);
 bool CLI_RunLine(struct CLIHandle *Handle,char *Line);
 void CLI_SendTelnetInitConnectionMsg(struct CLIHandle *Handle);
+uint32_t CLI_GetNextWakeup(struct CLIHandle *Handle);
+#ifdef CLI_WAIT_FOR_INPUT
+ bool CLI_WaitForInput(struct CLIHandle *Handle,uint32_t Timeout);
+#endif
 
 #ifdef CLI_REMOVE_CMDHELP
  #define CLI_CmdHelp_Start()
@@ -83,6 +109,7 @@ void CLI_SendTelnetInitConnectionMsg(struct CLIHandle *Handle);
  #define CLI_CmdHelp_SubArg(a,b)
  #define CLI_CmdHelp_OptionString(a,b,c)
  #define CLI_CmdHelp_DotDotDot()
+ #define CLI_CmdHelp_ArgType(a)
  #define CLI_CmdHelp_End()
 #else
  void CLI_CmdHelp_Start(void);
@@ -90,8 +117,13 @@ void CLI_SendTelnetInitConnectionMsg(struct CLIHandle *Handle);
  void CLI_CmdHelp_SubArg(const char *Label,const char *Desc);
  void CLI_CmdHelp_OptionString(int Level,const char *Option,const char *Desc);
  void CLI_CmdHelp_DotDotDot(void);
+ void CLI_CmdHelp_ArgType(e_CLIArgType Type);
  void CLI_CmdHelp_End(void);
 #endif
 void CLI_ShowCmdHelp(void);
+#ifdef CLI_TYPED_ARGS
+ int32_t CLI_GetArgValue(int Arg);
+ int CLI_GetOptionIndex(int Arg);
+#endif
 
 #endif
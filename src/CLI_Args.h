@@ -0,0 +1,209 @@
+/*******************************************************************************
+ * FILENAME: CLI_Args.h
+ *
+ * PROJECT:
+ *    MyCLI
+ *
+ * FILE DESCRIPTION:
+ *    This file has the command line splitter that is shared by all the
+ *    versions of the CLI.  It breaks a line up into args in place (the args
+ *    are left in the line buffer, nothing is copied out).
+ *
+ *    This is only included by the CLI.c files (it has static functions in
+ *    it).
+ *
+ * COPYRIGHT:
+ *    Copyright 2026 Paul Hutchinson
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files
+ *    (the "Software"), to deal in the Software without restriction,
+ *    including without limitation the rights to use, copy, modify,
+ *    merge, publish, distribute, sublicense, and/or sell copies of the
+ *    Software, and to permit persons to whom the Software is furnished
+ *    to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included
+ *    in all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ *    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *    SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * HISTORY:
+ *    Paul Hutchinson (17 Oct 2026)
+ *       Created
+ *
+ *******************************************************************************/
+#ifndef __CLI_ARGS_H_
+#define __CLI_ARGS_H_
+
+/***  HEADER FILES TO INCLUDE          ***/
+#include <stdbool.h>
+
+/***  DEFINES                          ***/
+
+/***  MACROS                           ***/
+#define CLI_IsArgSpace(c)           ((c)==' ' || (c)=='\t')
+
+/* All the chars that end or change an arg (\0 \t space " ' and \) are <= '
+   or are \ so everything else can be passed over with one compare */
+#define CLI_IsPlainArgChar(c)       ((unsigned char)(c)>'\'' && (c)!='\\')
+
+/***  TYPE DEFINITIONS                 ***/
+
+/***  CLASS DEFINITIONS                ***/
+
+/***  GLOBAL VARIABLE DEFINITIONS      ***/
+
+/***  EXTERNAL FUNCTION PROTOTYPES     ***/
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SplitArgs
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_SplitArgs(char *Line,const char **Argv,
+ *              unsigned int MaxArgs);
+ *
+ * PARAMETERS:
+ *    Line [I/O] -- The line to split up.  This is overwritten with the args.
+ *    Argv [O] -- The first 'MaxArgs' args are pointed to from here (NULL if
+ *                'MaxArgs' is 0)
+ *    MaxArgs [I] -- The number of entries in 'Argv'
+ *
+ * FUNCTION:
+ *    This function splits a line into args.  The args are written back over
+ *    the line one after the other, each one ending in a \0 (so the first arg
+ *    starts at 'Line' and the next one starts after the \0 of the one
+ *    before).  'Argv' is filled in as we go.  If there are more args than
+ *    fit in 'Argv' the rest are still split (and counted) and can be found
+ *    with CLI_FillArgv().
+ *
+ *    Args are split on runs of spaces and tabs.  "..." and '...' quote
+ *    spaces and can be anywhere in an arg (a"b c"d is the one arg 'ab cd',
+ *    "" is an empty arg).  A \ outside of '...' makes the next char
+ *    a normal char (\" \' \\ and \ space).  A quote that isn't closed runs
+ *    to the end of the line.
+ *
+ *    The args only ever get shorter than the text they came from so this
+ *    never writes past the \0 at the end of the line.  Until a quote or \
+ *    is dropped the args are already in the right place, so runs of plain
+ *    chars are just passed over (not copied).
+ *
+ * RETURNS:
+ *    The number of args on the line (this can be more than 'MaxArgs').
+ *
+ * SEE ALSO:
+ *    CLI_FillArgv()
+ ******************************************************************************/
+static unsigned int CLI_SplitArgs(char *Line,const char **Argv,
+        unsigned int MaxArgs)
+{
+    const char *In;     // The next char to read
+    char *Out;          // Where the next char of the arg goes
+    char Quote;         // The quote char we are in (0 if none)
+    unsigned int Argc;  // The number of args we have found
+
+    In=Line;
+    Out=Line;
+    Argc=0;
+    for(;;)
+    {
+        while(CLI_IsArgSpace(*In))
+            In++;
+        if(*In==0)
+            break;
+
+        if(Argc<MaxArgs)
+            Argv[Argc]=Out;
+
+        Quote=0;
+        for(;;)
+        {
+            if(Out==In)
+            {
+                while(CLI_IsPlainArgChar(*In))
+                    In++;
+                Out=(char *)In;
+            }
+            else
+            {
+                while(CLI_IsPlainArgChar(*In))
+                    *Out++=*In++;
+            }
+
+            if(*In==0)
+                break;
+
+            if(Quote==0 && CLI_IsArgSpace(*In))
+            {
+                /* End of the arg (the space is replaced by the \0 or
+                   is past it) */
+                In++;
+                break;
+            }
+
+            if((*In=='"' || *In=='\'') && (Quote==0 || Quote==*In))
+            {
+                Quote=Quote==0?*In:0;
+                In++;
+            }
+            else
+            {
+                if(*In=='\\' && Quote!='\'' && In[1]!=0)
+                    In++;
+                *Out++=*In++;
+            }
+        }
+        *Out++=0;
+        Argc++;
+    }
+    return Argc;
+}
+
+#ifdef CLI_MALLOC
+/*******************************************************************************
+ * NAME:
+ *    CLI_FillArgv
+ *
+ * SYNOPSIS:
+ *    static void CLI_FillArgv(const char *Line,const char **Argv,
+ *              unsigned int Argc);
+ *
+ * PARAMETERS:
+ *    Line [I] -- A line that was split with CLI_SplitArgs()
+ *    Argv [O] -- The array to fill in
+ *    Argc [I] -- The number of args CLI_SplitArgs() found
+ *
+ * FUNCTION:
+ *    This function fills in an argv from a line that was already split.
+ *    This is used when CLI_SplitArgs() found more args than fit in the argv
+ *    it was given (only the CLI_MALLOC() argv arena can grow so this is
+ *    only there if CLI_MALLOC() is defined).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SplitArgs()
+ ******************************************************************************/
+static void CLI_FillArgv(const char *Line,const char **Argv,unsigned int Argc)
+{
+    unsigned int r;
+
+    for(r=0;r<Argc;r++)
+    {
+        Argv[r]=Line;
+        while(*Line!=0)
+            Line++;
+        Line++;
+    }
+}
+#endif
+
+#endif
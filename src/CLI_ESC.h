@@ -0,0 +1,286 @@
+/*******************************************************************************
+ * FILENAME: CLI_ESC.h
+ *
+ * PROJECT:
+ *    MyCLI
+ *
+ * FILE DESCRIPTION:
+ *    This file has the ANSI escape seq decoder that is shared by the Full
+ *    and Small versions of the CLI.  It understands the CSI (ESC [ ...) and
+ *    SS3 (ESC O x) grammar and turns the seq's into editor keys.
+ *
+ *    This is only included by the CLI.c files (it has static functions and
+ *    tables in it).
+ *
+ * COPYRIGHT:
+ *    Copyright 2026 Paul Hutchinson
+ *
+ *    Permission is hereby granted, free of charge, to any person obtaining
+ *    a copy of this software and associated documentation files
+ *    (the "Software"), to deal in the Software without restriction,
+ *    including without limitation the rights to use, copy, modify,
+ *    merge, publish, distribute, sublicense, and/or sell copies of the
+ *    Software, and to permit persons to whom the Software is furnished
+ *    to do so, subject to the following conditions:
+ *
+ *    The above copyright notice and this permission notice shall be included
+ *    in all copies or substantial portions of the Software.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ *    MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *    IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ *    CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ *    TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ *    SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * HISTORY:
+ *    Paul Hutchinson (17 Oct 2026)
+ *       Created
+ *
+ *******************************************************************************/
+#ifndef __CLI_ESC_H_
+#define __CLI_ESC_H_
+
+/***  HEADER FILES TO INCLUDE          ***/
+#include <stdbool.h>
+#include <stdint.h>
+
+/***  DEFINES                          ***/
+#define CLI_ESC_MAX_PARAM                       9999    // Numbers in a seq stop here
+
+/***  MACROS                           ***/
+
+/***  TYPE DEFINITIONS                 ***/
+typedef enum
+{
+    e_CLIKey_None=0,        // Nothing to do (still in a seq or one we don't use)
+    e_CLIKey_NotESC,        // The char isn't part of a seq, process it as normal
+    e_CLIKey_Up,
+    e_CLIKey_Down,
+    e_CLIKey_Right,
+    e_CLIKey_Left,
+    e_CLIKey_Home,
+    e_CLIKey_End,
+    e_CLIKey_Insert,
+    e_CLIKey_Del,
+    e_CLIKey_PgUp,
+    e_CLIKey_PgDown,
+    e_CLIKey_Esc,           // ESC on it's own (or ESC ESC)
+    e_CLIKey_PasteStart,    // ESC [ 200 ~
+    e_CLIKey_PasteEnd,      // ESC [ 201 ~
+    e_CLIKeyMAX
+} e_CLIKeyType;
+
+typedef enum
+{
+    e_CLIESC_Idle=0,        // Not in a seq
+    e_CLIESC_ESC,           // Got the ESC
+    e_CLIESC_CSI,           // Got ESC [
+    e_CLIESC_SS3,           // Got ESC O
+    e_CLIESCMAX
+} e_CLIESCStateType;
+
+/***  CLASS DEFINITIONS                ***/
+struct CLIESCDecoder
+{
+    uint8_t State;          // The e_CLIESCStateType we are in
+    uint8_t ParamCount;     // The number of numbers we have started
+    uint16_t Param[2];      // The first 2 numbers in the seq (the rest are dropped)
+};
+
+/***  GLOBAL VARIABLE DEFINITIONS      ***/
+
+/* The keys for the final char of a CSI or SS3 seq ('A' to 'H') */
+static const uint8_t m_CLI_ESC_FinalKeys[]=
+{
+    e_CLIKey_Up,            // A
+    e_CLIKey_Down,          // B
+    e_CLIKey_Right,         // C
+    e_CLIKey_Left,          // D
+    e_CLIKey_None,          // E (keypad 5)
+    e_CLIKey_End,           // F
+    e_CLIKey_None,          // G
+    e_CLIKey_Home,          // H
+};
+
+/* The keys for ESC [ n ~ (VT220 / rxvt) */
+static const uint8_t m_CLI_ESC_TildeKeys[]=
+{
+    e_CLIKey_None,          // 0
+    e_CLIKey_Home,          // 1
+    e_CLIKey_Insert,        // 2
+    e_CLIKey_Del,           // 3
+    e_CLIKey_End,           // 4
+    e_CLIKey_PgUp,          // 5
+    e_CLIKey_PgDown,        // 6
+    e_CLIKey_Home,          // 7
+    e_CLIKey_End,           // 8
+};
+
+/***  EXTERNAL FUNCTION PROTOTYPES     ***/
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ESC_Start
+ *
+ * SYNOPSIS:
+ *    static void CLI_ESC_Start(struct CLIESCDecoder *Dec);
+ *
+ * PARAMETERS:
+ *    Dec [I/O] -- The decoder to start
+ *
+ * FUNCTION:
+ *    This function is called when an ESC comes in to start decoding a new
+ *    seq.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_ESC_Decode()
+ ******************************************************************************/
+static void CLI_ESC_Start(struct CLIESCDecoder *Dec)
+{
+    Dec->State=e_CLIESC_ESC;
+    Dec->ParamCount=0;
+    Dec->Param[0]=0;
+    Dec->Param[1]=0;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ESC_FinalKey
+ *
+ * SYNOPSIS:
+ *    static e_CLIKeyType CLI_ESC_FinalKey(struct CLIESCDecoder *Dec,
+ *              unsigned char c);
+ *
+ * PARAMETERS:
+ *    Dec [I] -- The decoder with the numbers from the seq in it
+ *    c [I] -- The final char of the seq
+ *
+ * FUNCTION:
+ *    This function looks up the key for a finished seq.  Modifiers (like
+ *    the 5 in ESC [ 1 ; 5 C) are ignored.
+ *
+ * RETURNS:
+ *    The key or e_CLIKey_None if it's not one we use.
+ *
+ * SEE ALSO:
+ *    CLI_ESC_Decode()
+ ******************************************************************************/
+static e_CLIKeyType CLI_ESC_FinalKey(struct CLIESCDecoder *Dec,unsigned char c)
+{
+    if(c>='A' && c<='H')
+        return (e_CLIKeyType)m_CLI_ESC_FinalKeys[c-'A'];
+
+    if(c=='~')
+    {
+        if(Dec->Param[0]<sizeof(m_CLI_ESC_TildeKeys))
+            return (e_CLIKeyType)m_CLI_ESC_TildeKeys[Dec->Param[0]];
+        if(Dec->Param[0]==200)
+            return e_CLIKey_PasteStart;
+        if(Dec->Param[0]==201)
+            return e_CLIKey_PasteEnd;
+    }
+    return e_CLIKey_None;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ESC_Decode
+ *
+ * SYNOPSIS:
+ *    static e_CLIKeyType CLI_ESC_Decode(struct CLIESCDecoder *Dec,
+ *              unsigned char c);
+ *
+ * PARAMETERS:
+ *    Dec [I/O] -- The decoder to feed the char to
+ *    c [I] -- The next input char after the ESC
+ *
+ * FUNCTION:
+ *    This function feeds one char into the escape seq decoder.  It should
+ *    only be called after CLI_ESC_Start() and until 'Dec->State' goes back
+ *    to e_CLIESC_Idle.
+ *
+ *    CSI seq's are ESC [ then any number of params (digits and ;) and
+ *    intermediate chars (0x20-0x3F) and then a final char (0x40-0x7E).
+ *    SS3 seq's are ESC O then one char.  A control char in the middle of a
+ *    CSI seq ends it and is handed back to be processed as normal.  An ESC
+ *    followed by anything else is dropped (ESC ESC gives e_CLIKey_Esc).
+ *
+ * RETURNS:
+ *    The key that was decoded, e_CLIKey_None if there is nothing to do, or
+ *    e_CLIKey_NotESC if 'c' was not part of the seq.
+ *
+ * SEE ALSO:
+ *    CLI_ESC_Start()
+ ******************************************************************************/
+static e_CLIKeyType CLI_ESC_Decode(struct CLIESCDecoder *Dec,unsigned char c)
+{
+    uint16_t *Param;
+
+    switch(Dec->State)
+    {
+        case e_CLIESC_ESC:
+            if(c=='[')
+            {
+                Dec->State=e_CLIESC_CSI;
+                return e_CLIKey_None;
+            }
+            if(c=='O')
+            {
+                Dec->State=e_CLIESC_SS3;
+                return e_CLIKey_None;
+            }
+            Dec->State=e_CLIESC_Idle;
+            if(c==27)
+                return e_CLIKey_Esc;
+            return e_CLIKey_None;
+        case e_CLIESC_SS3:
+            Dec->State=e_CLIESC_Idle;
+            return CLI_ESC_FinalKey(Dec,c);
+        case e_CLIESC_CSI:
+            if(c>='0' && c<='9')
+            {
+                if(Dec->ParamCount==0)
+                    Dec->ParamCount=1;
+                if(Dec->ParamCount<=2)
+                {
+                    Param=&Dec->Param[Dec->ParamCount-1];
+                    if(*Param<CLI_ESC_MAX_PARAM/10)
+                        *Param=*Param*10+c-'0';
+                }
+                return e_CLIKey_None;
+            }
+            if(c==';')
+            {
+                if(Dec->ParamCount==0)
+                    Dec->ParamCount=1;
+                if(Dec->ParamCount<255)
+                    Dec->ParamCount++;
+                return e_CLIKey_None;
+            }
+            if(c>=0x20 && c<=0x3F)
+            {
+                /* Private markers and intermediate chars, we don't use
+                   them */
+                return e_CLIKey_None;
+            }
+            Dec->State=e_CLIESC_Idle;
+            if(c>=0x40 && c<=0x7E)
+                return CLI_ESC_FinalKey(Dec,c);
+
+            /* A control char, the seq was cut off */
+            return e_CLIKey_NotESC;
+        case e_CLIESC_Idle:
+        case e_CLIESCMAX:
+        default:
+            Dec->State=e_CLIESC_Idle;
+        break;
+    }
+    return e_CLIKey_NotESC;
+}
+
+#endif
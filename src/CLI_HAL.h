@@ -99,6 +99,33 @@ bool HAL_CLI_IsCharAvailable(void);
 char HAL_CLI_GetChar(void);
 /*******************************************************************************
  * NAME:
+ *    HAL_CLI_Read
+ *
+ * SYNOPSIS:
+ *    int HAL_CLI_Read(char *Buff,int MaxBytes);
+ *
+ * PARAMETERS:
+ *    Buff [O] -- The buffer to fill with the bytes that have been read.
+ *    MaxBytes [I] -- The max number of bytes that will fit in 'Buff'
+ *
+ * FUNCTION:
+ *    This function is called to read a block of bytes from the input stream.
+ *    It should return all the bytes that are ready (up to 'MaxBytes') and
+ *    must not block.
+ *
+ *    This is optional.  It is only used if CLI_READ() is defined in
+ *    CLI_Options.h, in which case HAL_CLI_IsCharAvailable() and
+ *    HAL_CLI_GetChar() are not used.
+ *
+ * RETURNS:
+ *    The number of bytes placed in 'Buff'.  0 if there are no bytes ready.
+ *
+ * SEE ALSO:
+ *    HAL_CLI_GetChar()
+ ******************************************************************************/
+int HAL_CLI_Read(char *Buff,int MaxBytes);
+/*******************************************************************************
+ * NAME:
  *    HAL_CLI_PutChar
  *
  * SYNOPSIS:
@@ -122,6 +149,63 @@ char HAL_CLI_GetChar(void);
 void HAL_CLI_PutChar(char c);
 /*******************************************************************************
  * NAME:
+ *    HAL_CLI_Write
+ *
+ * SYNOPSIS:
+ *    void HAL_CLI_Write(const char *Buff,int Bytes);
+ *
+ * PARAMETERS:
+ *    Buff [I] -- The bytes to output.
+ *    Bytes [I] -- The number of bytes in 'Buff'
+ *
+ * FUNCTION:
+ *    This function is called when the command line wants to output a block
+ *    of chars.
+ *
+ *    This is optional.  It is only used if CLI_WRITE() is defined in
+ *    CLI_Options.h, in which case the prompt buffers its output and sends
+ *    it with this function instead of HAL_CLI_PutChar().
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    HAL_CLI_PutChar()
+ ******************************************************************************/
+void HAL_CLI_Write(const char *Buff,int Bytes);
+/*******************************************************************************
+ * NAME:
+ *    HAL_CLI_WaitForInput
+ *
+ * SYNOPSIS:
+ *    bool HAL_CLI_WaitForInput(uint32_t Timeout);
+ *
+ * PARAMETERS:
+ *    Timeout [I] -- The max number of milli seconds to wait.  If this is
+ *                   CLI_WAIT_FOREVER then there is no timeout.
+ *
+ * FUNCTION:
+ *    This function is called to block until there is input ready to be read
+ *    (or the timeout runs out).  On a PC this is normally a poll() /
+ *    select() / epoll_wait() on the input, on a micro it can sleep the CPU
+ *    (WFI) until the UART interrupt (or a timer) wakes it up.
+ *
+ *    It is fine for this to return early (for example when some other event
+ *    the main loop cares about happens).
+ *
+ *    This is optional.  It is only used if CLI_WAIT_FOR_INPUT() is defined
+ *    in CLI_Options.h, in which case CLI_WaitForInput() is available.
+ *
+ * RETURNS:
+ *    true -- There is input ready.
+ *    false -- We timed out.
+ *
+ * SEE ALSO:
+ *    HAL_CLI_IsCharAvailable(), HAL_CLI_Read()
+ ******************************************************************************/
+bool HAL_CLI_WaitForInput(uint32_t Timeout);
+/*******************************************************************************
+ * NAME:
  *    HAL_CLI_GetMilliSecCounter
  *
  * SYNOPSIS:
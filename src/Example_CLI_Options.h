@@ -45,7 +45,7 @@
 
 /***  DEFINES                          ***/
 #define CLI_MAX_PROMPTS                 1               // The number of command prompt we can have
-#define CLI_MAX_ARGS                    10              // The max number of argv's pointers (allocated on the stack)
+#define CLI_MAX_ARGS                    10              // The max number of args on a line (argv is on the stack).  With CLI_MALLOC this is the start size of the argv arena and there is no max
 #define CLI_MICRO_BUFFSIZE              40              // MICRO BUILD ONLY.  The number of bytes in the line editing buffer for the micro version
 
 /* If this is defined then the command help system (CLI_CmdHelpStart()) is
@@ -71,6 +71,125 @@
 #define CLI_PUTCHAR(c)                  HAL_CLI_PutChar(c)
 #define CLI_GET_MILLISEC_COUNTER()      HAL_CLI_GetMilliSecCounter()
 
+/* If this is defined then the prompt will read blocks of input with this
+   function (instead of one char at a time with CLI_IS_CHAR_AVAILABLE() and
+   CLI_GETCHAR()).  It must not block and returns the number of bytes read.
+   'CLI_READ_BUFFSIZE' is the size of the block buffer (per prompt). */
+//#define CLI_READ(buf,len)               HAL_CLI_Read(buf,len)
+//#define CLI_READ_BUFFSIZE               64
+
+/* If this is defined then the prompt will buffer its output and send it
+   in blocks with this function (instead of one char at a time with
+   CLI_PUTCHAR()).  The buffer is flushed before the prompt returns and
+   before a command is run.  'CLI_WRITE_BUFFSIZE' is the size of the output
+   buffer (per prompt). */
+//#define CLI_WRITE(buf,len)              HAL_CLI_Write(buf,len)
+//#define CLI_WRITE_BUFFSIZE              128
+
+/* If this is defined then CLI_WaitForInput() is available so the main loop
+   can sleep until there is something to do instead of polling the prompt.
+   It must block until there is input ready or 'ms' milli seconds have gone
+   by (CLI_WAIT_FOREVER = no timeout).  It returns true if there is input. */
+//#define CLI_WAIT_FOR_INPUT(ms)          HAL_CLI_WaitForInput(ms)
+
+/* If these are defined then CLI_GetHandle() will allocate more prompts with
+   CLI_MALLOC() once the CLI_MAX_PROMPTS pool is used up, and
+   CLI_AllocBuffers() is available to allocate the line / history buffers for
+   a prompt.  The argv for a command is kept in an arena on the prompt that
+   grows when a line has more args than fit (so CLI_MAX_ARGS is only the
+   start size).  Prompts given back with CLI_FreeHandle() are reused. */
+//#define CLI_MALLOC(size)                malloc(size)
+//#define CLI_FREE(ptr)                   free(ptr)
+
+/* Set these if prompts are run from more than one thread (each prompt must
+   still only be used by one thread at a time).  CLI_THREAD_LOCAL is added to
+   the library's "prompt running a command" var (which the help system and
+   auto complete use) so each thread gets its own.  CLI_LOCK() / CLI_UNLOCK()
+   are put around the handle pool in CLI_GetHandle() / CLI_FreeHandle(). */
+//#define CLI_THREAD_LOCAL                _Thread_local
+//#define CLI_LOCK()                      pthread_mutex_lock(&g_CLIPoolMutex)
+//#define CLI_UNLOCK()                    pthread_mutex_unlock(&g_CLIPoolMutex)
+
+/* If CLI_CMD_HASH_SIZE is defined CLI_RunLine() finds the command with a
+   hash index of g_CLICmds[] (built the first time a prompt is init'ed)
+   instead of checking each command in turn.  This must be a power of 2 and
+   bigger than g_CLICmdsCount (about 2x is good).  If there are too many
+   commands the index is not used. */
+//#define CLI_CMD_HASH_SIZE               64
+
+/* If CLI_CMD_PERFECT_HASH is defined it is the name of a .h file made by
+   Tools/MakeCmdHash.py from your g_CLICmds[] table.  CLI_RunLine() then
+   finds commands with the minimal perfect hash in that file.  The tables
+   are const (flash) so this uses no RAM (just a flag), but the .h must
+   be made again each time g_CLICmds[] changes.  If it's out of date
+   (checked when a prompt is init'ed) each command is checked in turn
+   instead.  This can not be used with CLI_CMD_HASH_SIZE. */
+//#define CLI_CMD_PERFECT_HASH            "CLI_CmdHash.h"
+
+/* If CLI_CMD_TRIE_SIZE is defined CLI_RunLine() finds the command with a
+   trie of the names in g_CLICmds[] (built the first time a prompt is
+   init'ed).  Commands can then be typed in any case and cut short to any
+   start that is only one command (dr for Drive).  Tab completion of the
+   command name also uses it.  This is the number of trie nodes (10 bytes
+   each), one per char of each name plus one is always enough.  If there
+   are too many the trie is not used.  This can not be used with
+   CLI_CMD_HASH_SIZE or CLI_CMD_PERFECT_HASH.  (Full and Small only) */
+//#define CLI_CMD_TRIE_SIZE               128
+
+/* If CLI_AUTOCOMPLETE_CACHE_SIZE is defined each prompt keeps a list of
+   this many option strings for the arg that tab is completing.  The first
+   tab calls the command's help once to fill it in and the next tabs use
+   the list (without it the command is called again for every option
+   checked).  Commands with more options than this still work, they just
+   don't use the cache.  The option strings must stay valid until a key
+   other than tab is pressed.  (Full only) */
+//#define CLI_AUTOCOMPLETE_CACHE_SIZE     32
+
+/* CLI_ESC_TIMEOUT is how long (in ms) to wait for the rest of an escape
+   seq after an ESC before taking it as the ESC key (clear the line).  If
+   it's not defined 250 is used.  CLI_GetNextWakeup() gives back how much
+   of it is left so the main loop can sleep for just that long. */
+//#define CLI_ESC_TIMEOUT                 250
+
+/* If CLI_ESC_BURST is defined the bytes of an escape seq are taken to
+   always arrive together (telnet, USB CDC, anything that sends a key in one
+   block).  An ESC with nothing waiting after it is then the ESC key right
+   away, without waiting for CLI_ESC_TIMEOUT.  CLI_ESC_TIMEOUT is still used
+   when a seq is cut off part way.  Don't use this on a slow UART where the
+   bytes come in one at a time. */
+//#define CLI_ESC_BURST
+
+/* CLI_SEARCH_BUFFSIZE is the longest string (+1) you can type in to a
+   Ctrl-R history search. */
+//#define CLI_SEARCH_BUFFSIZE             32
+
+/* If CLI_HISTORY_SAVE is defined it is called with each line that is added
+   to the history (Full and Small only).  Append it to a file, flash, etc
+   and give the saved lines back with CLI_AddHistoryEntry() (oldest first)
+   after CLI_SetHistoryBuffer() to keep the history over a restart.  It is
+   called from the prompt, so don't wait for the write to finish.  Only the
+   last few lines (what fits in the history buffer) need to be loaded.
+   Lines that are dropped as the same as the last one (with
+   CLI_HISTORY_DEDUP_SIZE) are not passed to it. */
+//#define CLI_HISTORY_SAVE(Handle,Line,Len) HAL_CLI_SaveHistory(Line,Len)
+
+/* If CLI_HISTORY_DEDUP_SIZE is defined a line that is already in the
+   history isn't added again, the old copy is moved to the end instead.
+   Each prompt keeps a count of the entries and the offset of the newest
+   one for this many hash buckets (2 bytes + an unsigned int each) so most
+   new lines are known not to be dups (and most dups are found) without
+   looking through the history.  (Full and Small only) */
+//#define CLI_HISTORY_DEDUP_SIZE          32
+
+/* If CLI_TYPED_ARGS is defined commands in g_CLICmds[] can set 'TypedArgs'.
+   The args for these commands are checked with the help block before the
+   command is run (CLI_CmdHelp_ArgType() sets the type of the last arg) and
+   the decoded values are read with CLI_GetArgValue() and
+   CLI_GetOptionIndex().  This is the number of args (argv[1] on) that can
+   be decoded (12 bytes each per prompt on a 32 bit CPU).
+   (Full and Small only, CLI_REMOVE_CMDHELP can not be used) */
+//#define CLI_TYPED_ARGS                  8
+
 /* Example function prototypes */
 #include <stdbool.h>
 #include <stdint.h>
@@ -118,6 +237,33 @@ bool HAL_CLI_IsCharAvailable(void);
  *    HAL_CLI_IsCharAvailable(), HAL_CLI_PutChar()
  ******************************************************************************/
 char HAL_CLI_GetChar(void);
+/*******************************************************************************
+ * NAME:
+ *    HAL_CLI_Read
+ *
+ * SYNOPSIS:
+ *    int HAL_CLI_Read(char *Buff,int MaxBytes);
+ *
+ * PARAMETERS:
+ *    Buff [O] -- The buffer to fill with the bytes that have been read.
+ *    MaxBytes [I] -- The max number of bytes that will fit in 'Buff'
+ *
+ * FUNCTION:
+ *    This function is called to read a block of bytes from the input stream.
+ *    It should return all the bytes that are ready (up to 'MaxBytes') and
+ *    must not block.
+ *
+ *    This is optional.  It is only used if CLI_READ() is defined in
+ *    CLI_Options.h, in which case HAL_CLI_IsCharAvailable() and
+ *    HAL_CLI_GetChar() are not used.
+ *
+ * RETURNS:
+ *    The number of bytes placed in 'Buff'.  0 if there are no bytes ready.
+ *
+ * SEE ALSO:
+ *    HAL_CLI_GetChar()
+ ******************************************************************************/
+int HAL_CLI_Read(char *Buff,int MaxBytes);
 /*******************************************************************************
  * NAME:
  *    HAL_CLI_PutChar
@@ -143,6 +289,63 @@ char HAL_CLI_GetChar(void);
 void HAL_CLI_PutChar(char c);
 /*******************************************************************************
  * NAME:
+ *    HAL_CLI_Write
+ *
+ * SYNOPSIS:
+ *    void HAL_CLI_Write(const char *Buff,int Bytes);
+ *
+ * PARAMETERS:
+ *    Buff [I] -- The bytes to output.
+ *    Bytes [I] -- The number of bytes in 'Buff'
+ *
+ * FUNCTION:
+ *    This function is called when the command line wants to output a block
+ *    of chars.
+ *
+ *    This is optional.  It is only used if CLI_WRITE() is defined in
+ *    CLI_Options.h, in which case the prompt buffers its output and sends
+ *    it with this function instead of HAL_CLI_PutChar().
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    HAL_CLI_PutChar()
+ ******************************************************************************/
+void HAL_CLI_Write(const char *Buff,int Bytes);
+/*******************************************************************************
+ * NAME:
+ *    HAL_CLI_WaitForInput
+ *
+ * SYNOPSIS:
+ *    bool HAL_CLI_WaitForInput(uint32_t Timeout);
+ *
+ * PARAMETERS:
+ *    Timeout [I] -- The max number of milli seconds to wait.  If this is
+ *                   CLI_WAIT_FOREVER then there is no timeout.
+ *
+ * FUNCTION:
+ *    This function is called to block until there is input ready to be read
+ *    (or the timeout runs out).  On a PC this is normally a poll() /
+ *    select() / epoll_wait() on the input, on a micro it can sleep the CPU
+ *    (WFI) until the UART interrupt (or a timer) wakes it up.
+ *
+ *    It is fine for this to return early (for example when some other event
+ *    the main loop cares about happens).
+ *
+ *    This is optional.  It is only used if CLI_WAIT_FOR_INPUT() is defined
+ *    in CLI_Options.h, in which case CLI_WaitForInput() is available.
+ *
+ * RETURNS:
+ *    true -- There is input ready.
+ *    false -- We timed out.
+ *
+ * SEE ALSO:
+ *    HAL_CLI_IsCharAvailable(), HAL_CLI_Read()
+ ******************************************************************************/
+bool HAL_CLI_WaitForInput(uint32_t Timeout);
+/*******************************************************************************
+ * NAME:
  *    HAL_CLI_GetMilliSecCounter
  *
  * SYNOPSIS:
@@ -167,5 +370,27 @@ void HAL_CLI_PutChar(char c);
  *    
  ******************************************************************************/
 uint32_t HAL_CLI_GetMilliSecCounter(void);
+/*******************************************************************************
+ * NAME:
+ *    HAL_CLI_SaveHistory
+ *
+ * SYNOPSIS:
+ *    void HAL_CLI_SaveHistory(const char *Line,unsigned int Len);
+ *
+ * PARAMETERS:
+ *    Line [I] -- The line that was added to the history
+ *    Len [I] -- The number of chars in 'Line'
+ *
+ * FUNCTION:
+ *    This function is called (by CLI_HISTORY_SAVE()) to save a line that
+ *    was added to the history so it can be loaded again next time.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_AddHistoryEntry()
+ ******************************************************************************/
+void HAL_CLI_SaveHistory(const char *Line,unsigned int Len);
 
 #endif
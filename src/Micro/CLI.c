@@ -51,23 +51,51 @@
 
 /*** HEADER FILES TO INCLUDE  ***/
 #include "../CLI.h"
+#include "../CLI_Args.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdbool.h>
 
+#ifdef CLI_CMD_PERFECT_HASH
+ #include CLI_CMD_PERFECT_HASH     // Made by Tools/MakeCmdHash.py
+ #ifndef CLI_CMDPHASH_NAMES_HASH
+  #error The CLI_CMD_PERFECT_HASH .h is from an old MakeCmdHash.py, make it again
+ #endif
+#endif
+
 /*** DEFINES                  ***/
 #define HELP_INDENT                                     4
 
+#ifndef CLI_READ_BUFFSIZE
+ #define CLI_READ_BUFFSIZE                              16
+#endif
+
 /*** MACROS                   ***/
 
 /*** TYPE DEFINITIONS         ***/
 
 /*** FUNCTION PROTOTYPES      ***/
 static void CLIPrintStr(const char *Str);
+static char *CLI_ProcessInputChar(unsigned char c);
+static const struct CLICommand *CLI_FindCmd(const char *Line);
+#ifdef CLI_CMD_PERFECT_HASH
+static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len);
+static uint32_t CLI_MixCmdHash(uint32_t Hash);
+static void CLI_CheckCmdPHash(void);
+#endif
 
 /*** VARIABLE DEFINITIONS     ***/
 static char m_CLI_LineBuff[CLI_MICRO_BUFFSIZE];
+static unsigned int m_CLI_LineBuffLen;     // The number of chars in m_CLI_LineBuff
+#ifdef CLI_READ
+static char m_CLI_ReadBuff[CLI_READ_BUFFSIZE];
+static unsigned int m_CLI_ReadBuffLen;
+static unsigned int m_CLI_ReadBuffPos;
+#endif
+#ifdef CLI_CMD_PERFECT_HASH
+static bool m_CLI_CmdPHashOK;              // Were the perfect hash tables made for this g_CLICmds[] (false=scan g_CLICmds[])
+#endif
 
 /*******************************************************************************
  * NAME:
@@ -95,6 +123,29 @@ struct CLIHandle *CLI_GetHandle(void)
     return (struct CLIHandle *)-1;
 }
 
+/*******************************************************************************
+ * NAME:
+ *    CLI_FreeHandle
+ *
+ * SYNOPSIS:
+ *    void CLI_FreeHandle(struct CLIHandle *Handle);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to free
+ *
+ * FUNCTION:
+ *    This function does nothing (there is only the one prompt).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_GetHandle()
+ ******************************************************************************/
+void CLI_FreeHandle(struct CLIHandle *Handle)
+{
+}
+
 /*******************************************************************************
  * NAME:
  *    CLI_InitPrompt
@@ -117,6 +168,9 @@ struct CLIHandle *CLI_GetHandle(void)
  ******************************************************************************/
 void CLI_InitPrompt(struct CLIHandle *Handle)
 {
+#ifdef CLI_CMD_PERFECT_HASH
+    CLI_CheckCmdPHash();
+#endif
 }
 
 /*******************************************************************************
@@ -132,6 +186,9 @@ void CLI_InitPrompt(struct CLIHandle *Handle)
  * FUNCTION:
  *    This function gets an input line from the user.  It is non-blocking.
  *
+ *    If CLI_READ() is defined in the options then this will read a block
+ *    of bytes at a time and process all of them in one call.
+ *
  * RETURNS:
  *    A pointer to the line buffer or NULL if the line is not ready yet.
  *
@@ -140,12 +197,146 @@ void CLI_InitPrompt(struct CLIHandle *Handle)
  ******************************************************************************/
 char *CLI_GetLine(struct CLIHandle *Handle)
 {
-    unsigned char c;
+#ifdef CLI_READ
+    char *Line;
+    int Bytes;
 
+    /* If we have used up the last block, read in the next one */
+    if(m_CLI_ReadBuffPos>=m_CLI_ReadBuffLen)
+    {
+        m_CLI_ReadBuffPos=0;
+        m_CLI_ReadBuffLen=0;
+        Bytes=CLI_READ(m_CLI_ReadBuff,sizeof(m_CLI_ReadBuff));
+        if(Bytes>0)
+            m_CLI_ReadBuffLen=Bytes;
+    }
+
+    /* Process the whole block (unless we finish a line) */
+    while(m_CLI_ReadBuffPos<m_CLI_ReadBuffLen)
+    {
+        Line=CLI_ProcessInputChar(m_CLI_ReadBuff[m_CLI_ReadBuffPos++]);
+        if(Line!=NULL)
+            return Line;
+    }
+    return NULL;
+#else
     if(!CLI_IS_CHAR_AVAILABLE())
         return NULL;
 
-    c=CLI_GETCHAR();
+    return CLI_ProcessInputChar(CLI_GETCHAR());
+#endif
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetNextWakeup
+ *
+ * SYNOPSIS:
+ *    uint32_t CLI_GetNextWakeup(struct CLIHandle *Handle);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *
+ * FUNCTION:
+ *    This function returns how long the prompt can be left alone if no new
+ *    input comes in.  The main loop can use this to sleep (poll(), WFI, etc)
+ *    instead of calling CLI_RunCmdPrompt() over and over.
+ *
+ *    The micro version does not time anything so this only returns 0
+ *    if there are bytes left over from the last CLI_READ() block.
+ *
+ * RETURNS:
+ *    The number of milli seconds until CLI_RunCmdPrompt() (or CLI_GetLine())
+ *    needs to be called again, 0 if it needs to be called right away, or
+ *    CLI_WAIT_FOREVER if it only needs to be called when there is new input.
+ *
+ * SEE ALSO:
+ *    CLI_WaitForInput(), CLI_GetLine()
+ ******************************************************************************/
+uint32_t CLI_GetNextWakeup(struct CLIHandle *Handle)
+{
+#ifdef CLI_READ
+    /* We still have input left over from the last block */
+    if(m_CLI_ReadBuffPos<m_CLI_ReadBuffLen)
+        return 0;
+#endif
+
+    return CLI_WAIT_FOREVER;
+}
+
+#ifdef CLI_WAIT_FOR_INPUT
+/*******************************************************************************
+ * NAME:
+ *    CLI_WaitForInput
+ *
+ * SYNOPSIS:
+ *    bool CLI_WaitForInput(struct CLIHandle *Handle,uint32_t Timeout);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Timeout [I] -- The max number of milli seconds to wait for.  Use
+ *                   CLI_WAIT_FOREVER to wait until there is input.
+ *
+ * FUNCTION:
+ *    This function blocks until there is input for the prompt (using
+ *    CLI_WAIT_FOR_INPUT()), the timeout runs out, or the prompt has
+ *    something it needs to time out (the ESC key).  This lets the main loop
+ *    sleep instead of spinning on CLI_RunCmdPrompt():
+ *
+ *        while(!quit)
+ *        {
+ *            CLI_WaitForInput(Prompt,CLI_WAIT_FOREVER);
+ *            CLI_RunCmdPrompt(Prompt);
+ *        }
+ *
+ *    If you need to wait on other things as well then use
+ *    CLI_GetNextWakeup() to get the timeout for your own wait instead.
+ *
+ * RETURNS:
+ *    true -- There is input ready (or the prompt has work to do).
+ *    false -- We timed out.
+ *
+ * SEE ALSO:
+ *    CLI_GetNextWakeup(), CLI_RunCmdPrompt()
+ ******************************************************************************/
+bool CLI_WaitForInput(struct CLIHandle *Handle,uint32_t Timeout)
+{
+    uint32_t Wakeup;
+
+    Wakeup=CLI_GetNextWakeup(Handle);
+    if(Wakeup==0)
+        return true;
+
+    if(Wakeup<Timeout)
+        Timeout=Wakeup;
+
+    return CLI_WAIT_FOR_INPUT(Timeout);
+}
+#endif
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ProcessInputChar
+ *
+ * SYNOPSIS:
+ *    static char *CLI_ProcessInputChar(unsigned char c);
+ *
+ * PARAMETERS:
+ *    c [I] -- The char that was input.
+ *
+ * FUNCTION:
+ *    This is helper function for the CLI_GetLine() function.  It processes
+ *    one input char.
+ *
+ * RETURNS:
+ *    A pointer to the line buffer if this char finished the line or NULL
+ *    if the line is not ready yet.
+ *
+ * SEE ALSO:
+ *    CLI_GetLine()
+ ******************************************************************************/
+static char *CLI_ProcessInputChar(unsigned char c)
+{
     switch(c)
     {
         case 0:     // We ignore 0's
@@ -164,19 +355,19 @@ char *CLI_GetLine(struct CLIHandle *Handle)
         break;
         case '\b':
         case 127:
-            if(m_CLI_LineBuff[0]!=0)
+            if(m_CLI_LineBuffLen>0)
             {
-                m_CLI_LineBuff[STRLEN(m_CLI_LineBuff)-1]=0;
+                m_CLI_LineBuff[--m_CLI_LineBuffLen]=0;
                 CLI_PUTCHAR('\b');
                 CLI_PUTCHAR(' ');
                 CLI_PUTCHAR('\b');
             }
         break;
         default:
-            if(STRLEN(m_CLI_LineBuff)<sizeof(m_CLI_LineBuff)-1)
+            if(m_CLI_LineBuffLen<sizeof(m_CLI_LineBuff)-1)
             {
-                m_CLI_LineBuff[STRLEN(m_CLI_LineBuff)+1]=0;
-                m_CLI_LineBuff[STRLEN(m_CLI_LineBuff)]=c;
+                m_CLI_LineBuff[m_CLI_LineBuffLen++]=c;
+                m_CLI_LineBuff[m_CLI_LineBuffLen]=0;
                 CLI_PUTCHAR(c);
             }
         break;
@@ -237,13 +428,68 @@ void CLI_SetLineBuffer(struct CLIHandle *Handle,char *LineBuff,int MaxSize)
  *    NONE
  *
  * SEE ALSO:
- *    
+ *    CLI_AddHistoryEntry()
  ******************************************************************************/
 void CLI_SetHistoryBuffer(struct CLIHandle *Handle,char *HistoryBuff,
         int MaxSize)
+{
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_AddHistoryEntry
+ *
+ * SYNOPSIS:
+ *    void CLI_AddHistoryEntry(struct CLIHandle *Handle,const char *Line);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Line [I] -- The line to add to the end of the history
+ *
+ * FUNCTION:
+ *    This function does nothing.  The micro version has no history.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SetHistoryBuffer()
+ ******************************************************************************/
+void CLI_AddHistoryEntry(struct CLIHandle *Handle,const char *Line)
 {
 }
 
+#ifdef CLI_MALLOC
+/*******************************************************************************
+ * NAME:
+ *    CLI_AllocBuffers
+ *
+ * SYNOPSIS:
+ *    bool CLI_AllocBuffers(struct CLIHandle *Handle,unsigned int LineSize,
+ *          unsigned int HistorySize);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the prompt to set the buffers for
+ *    LineSize [I] -- The size of the line buffer
+ *    HistorySize [I] -- The size of the history buffer
+ *
+ * FUNCTION:
+ *    This function does nothing.  The micro version always uses its own
+ *    buffer (see CLI_MICRO_BUFFSIZE).
+ *
+ * RETURNS:
+ *    true
+ *
+ * SEE ALSO:
+ *    CLI_SetLineBuffer()
+ ******************************************************************************/
+bool CLI_AllocBuffers(struct CLIHandle *Handle,unsigned int LineSize,
+        unsigned int HistorySize)
+{
+    return true;
+}
+#endif
+
 /*******************************************************************************
  * NAME:
  *    CLI_SetPasswordMode
@@ -270,6 +516,57 @@ void CLI_SetPasswordMode(struct CLIHandle *Handle,bool OnOff)
 
 /*******************************************************************************
  * NAME:
+ *    CLI_SetANSIMode
+ *
+ * SYNOPSIS:
+ *    void CLI_SetANSIMode(struct CLIHandle *Handle,bool OnOff);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    OnOff [I] -- true = the terminal understands ANSI cursor commands,
+ *                 false = dumb terminal
+ *
+ * FUNCTION:
+ *    This function turns on/off ANSI mode.  The micro version only edits
+ *    at the end of the line so there is nothing to redraw.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    
+ ******************************************************************************/
+void CLI_SetANSIMode(struct CLIHandle *Handle,bool OnOff)
+{
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SetTermWidth
+ *
+ * SYNOPSIS:
+ *    void CLI_SetTermWidth(struct CLIHandle *Handle,unsigned int Width);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Width [I] -- The number of columns the terminal has (0 = don't know)
+ *
+ * FUNCTION:
+ *    This function does nothing.  The micro version doesn't scroll the
+ *    line.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SetANSIMode()
+ ******************************************************************************/
+void CLI_SetTermWidth(struct CLIHandle *Handle,unsigned int Width)
+{
+}
+
+/*******************************************************************************
+ * NAME:
  *    CLI_SetPromptStr
  *
  * SYNOPSIS:
@@ -312,7 +609,7 @@ void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt)
  *    NONE
  *
  * SEE ALSO:
- *    
+ *    CLI_WaitForInput(), CLI_GetNextWakeup()
  ******************************************************************************/
 void CLI_RunCmdPrompt(struct CLIHandle *Handle)
 {
@@ -326,6 +623,7 @@ void CLI_RunCmdPrompt(struct CLIHandle *Handle)
 
         /* We are done with the buffer, reset for the next input */
         *m_CLI_LineBuff=0;
+        m_CLI_LineBuffLen=0;
 
         CLI_DrawPrompt(NULL);
     }
@@ -343,73 +641,233 @@ void CLI_RunCmdPrompt(struct CLIHandle *Handle)
  *    Line [I] -- The raw line to process.  This will be overwritten.
  *
  * FUNCTION:
- *    This function takes a raw line and runs it.
+ *    This function takes a raw line and runs it.  The line is split with
+ *    CLI_SplitArgs() (quotes, \ and runs of spaces).
  *
  * RETURNS:
  *    true -- Command was found.
- *    false -- The command is unknown.
+ *    false -- The command is unknown (or it has more than CLI_MAX_ARGS
+ *             args).
  *
  * SEE ALSO:
  *    
  ******************************************************************************/
 bool CLI_RunLine(struct CLIHandle *Handle,char *Line)
 {
-    unsigned int cmd;    // The command index we are looking at
-    int len;    // The len of the current command we are looking at
-    uint16_t Argc;          // The number of args
-    char *Argv[CLI_MAX_ARGS];   // The argv's we are sending
-    char *Pos;  // The current pos in the line we are processing
-    char *StartOfLastArg;   // The pos of the last arg
+    const struct CLICommand *Cmd;   // The command the line is for
+    unsigned int Argc;      // The number of args
+    const char *Argv[CLI_MAX_ARGS]; // The argv's we are sending
+
+    while(CLI_IsArgSpace(*Line))
+        Line++;
 
     /* Empty lines do not make errors */
     if(*Line==0)
         return true;
 
-    /* We got a line, scan the commands */
+    /* We got a line, find the command */
+    Cmd=CLI_FindCmd(Line);
+    if(Cmd==NULL)
+        return false;
+
+    /* Found a command, run it */
+    /* Split up the command line */
+    Argc=CLI_SplitArgs(Line,Argv,CLI_MAX_ARGS);
+    if(Argc>CLI_MAX_ARGS)
+        return false;
+
+    Cmd->Exec((int)Argc,Argv);
+
+    return true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FindCmd
+ *
+ * SYNOPSIS:
+ *    static const struct CLICommand *CLI_FindCmd(const char *Line);
+ *
+ * PARAMETERS:
+ *    Line [I] -- The line to find the command for.  The command is the
+ *                first word on the line.
+ *
+ * FUNCTION:
+ *    This function finds the command in g_CLICmds[] that a line starts
+ *    with.  If CLI_CMD_PERFECT_HASH is defined this uses the const tables
+ *    made by Tools/MakeCmdHash.py (if CLI_CheckCmdPHash() found they match
+ *    g_CLICmds[]), if not it scans g_CLICmds[].
+ *
+ * RETURNS:
+ *    The command or NULL if it was not found.
+ *
+ * SEE ALSO:
+ *    CLI_RunLine(), CLI_CheckCmdPHash()
+ ******************************************************************************/
+static const struct CLICommand *CLI_FindCmd(const char *Line)
+{
+    unsigned int cmd;   // The command index we are looking at
+    unsigned int len;   // The len of the current command we are looking at
+#ifdef CLI_CMD_PERFECT_HASH
+    uint32_t Hash;      // The hash of the command on the line
+    unsigned int Slot;  // The slot in the index we are looking at
+
+    if(m_CLI_CmdPHashOK && g_CLICmdsCount==CLI_CMDPHASH_COUNT)
+    {
+        /* Only one command can have this hash, see if it's the one */
+        Hash=CLI_HashCmd(Line,&len);
+        Slot=CLI_MixCmdHash(Hash^
+                g_CLICmdPHashDisp[Hash%CLI_CMDPHASH_BUCKETS])%
+                CLI_CMDPHASH_COUNT;
+        cmd=g_CLICmdPHashIndex[Slot];
+        if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
+                g_CLICmds[cmd].Cmd[len]==0)
+        {
+            return &g_CLICmds[cmd];
+        }
+        return NULL;
+    }
+#endif
+
     for(cmd=0;cmd<g_CLICmdsCount;cmd++)
     {
         len=STRLEN(g_CLICmds[cmd].Cmd);
         if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
-                (Line[len]==0 || Line[len]==' '))
+                (Line[len]==0 || CLI_IsArgSpace(Line[len])))
         {
-            /* Found a command, run it */
-            /* Split up the command line */
-            Argc=0;
-            Pos=Line;
-            StartOfLastArg=Line;
-            while(*Pos!=0)
-            {
-                if(*Pos==' ')
-                {
-                    *Pos=0;
-                    Argv[Argc++]=StartOfLastArg;
-                    if(Argc>CLI_MAX_ARGS)
-                        return false;
-
-                    Pos++;
-                    while(*Pos==' ')
-                        Pos++;
-                    StartOfLastArg=Pos;
-                }
-                else
-                {
-                    Pos++;
-                }
-            }
-
-            /* Add in the last arg */
-            Argv[Argc++]=StartOfLastArg;
-
-            g_CLICmds[cmd].Exec(Argc,(const char **)Argv);
-
-            break;
+            return &g_CLICmds[cmd];
         }
     }
+    return NULL;
+}
 
-    if(cmd==g_CLICmdsCount)
-        return false;
-    return true;
+#ifdef CLI_CMD_PERFECT_HASH
+/*******************************************************************************
+ * NAME:
+ *    CLI_HashCmd
+ *
+ * SYNOPSIS:
+ *    static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len);
+ *
+ * PARAMETERS:
+ *    Str [I] -- The string to hash.  This stops at a space or the end of
+ *               the string.
+ *    Len [O] -- The number of chars that where hashed
+ *
+ * FUNCTION:
+ *    This function hashes a command name (FNV-1a).  A-Z are hashed as a-z
+ *    so this works if STRNCMP() ignores case or not.  This must match
+ *    HashCmd() in Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    The hash value
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd()
+ ******************************************************************************/
+static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len)
+{
+    uint32_t Hash;
+    unsigned int r;
+    char c;
+
+    Hash=2166136261U;
+    for(r=0;Str[r]!=0 && !CLI_IsArgSpace(Str[r]);r++)
+    {
+        c=Str[r];
+        if(c>='A' && c<='Z')
+            c+='a'-'A';
+        Hash^=(uint8_t)c;
+        Hash*=16777619U;
+    }
+    *Len=r;
+    return Hash;
 }
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+/*******************************************************************************
+ * NAME:
+ *    CLI_MixCmdHash
+ *
+ * SYNOPSIS:
+ *    static uint32_t CLI_MixCmdHash(uint32_t Hash);
+ *
+ * PARAMETERS:
+ *    Hash [I] -- The command hash xor'ed with the displacement from
+ *                g_CLICmdPHashDisp[]
+ *
+ * FUNCTION:
+ *    This function mixes up the bits in a hash (the murmur3 finalizer) to
+ *    get the slot in g_CLICmdPHashIndex[].  This must match MixCmdHash() in
+ *    Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    The mixed hash value
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd(), CLI_HashCmd()
+ ******************************************************************************/
+static uint32_t CLI_MixCmdHash(uint32_t Hash)
+{
+    Hash^=Hash>>16;
+    Hash*=0x85EBCA6BU;
+    Hash^=Hash>>13;
+    Hash*=0xC2B2AE35U;
+    Hash^=Hash>>16;
+    return Hash;
+}
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+/*******************************************************************************
+ * NAME:
+ *    CLI_CheckCmdPHash
+ *
+ * SYNOPSIS:
+ *    static void CLI_CheckCmdPHash(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function checks that the perfect hash tables were made for the
+ *    g_CLICmds[] we have.  The names in g_CLICmds[] are hashed in order
+ *    and checked against CLI_CMDPHASH_NAMES_HASH from the .h.  If a
+ *    command was added, removed, renamed or moved and the .h wasn't made
+ *    again the tables are not used and we fall back to scanning
+ *    g_CLICmds[].  It is called from CLI_InitPrompt().
+ *
+ *    This must match NamesHash() in Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd()
+ ******************************************************************************/
+static void CLI_CheckCmdPHash(void)
+{
+    unsigned int cmd;
+    const char *Name;
+    uint32_t Hash;
+
+    /* FNV-1a of each name (with its \0) */
+    Hash=2166136261U;
+    for(cmd=0;cmd<g_CLICmdsCount;cmd++)
+    {
+        Name=g_CLICmds[cmd].Cmd;
+        do
+        {
+            Hash^=(uint8_t)*Name;
+            Hash*=16777619U;
+        } while(*Name++!=0);
+    }
+
+    m_CLI_CmdPHashOK=(g_CLICmdsCount==CLI_CMDPHASH_COUNT &&
+            Hash==CLI_CMDPHASH_NAMES_HASH);
+}
+#endif
 
 /*******************************************************************************
  * NAME:
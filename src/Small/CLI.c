@@ -43,15 +43,80 @@
 
 /*** HEADER FILES TO INCLUDE  ***/
 #include "../CLI.h"
+#include "../CLI_ESC.h"
+#include "../CLI_Args.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdbool.h>
 
+#ifdef CLI_CMD_PERFECT_HASH
+ #include CLI_CMD_PERFECT_HASH     // Made by Tools/MakeCmdHash.py
+#endif
+
 /*** DEFINES                  ***/
 #define HELP_INDENT                                     4
 
+#ifndef CLI_ESC_TIMEOUT
+ #define CLI_ESC_TIMEOUT                                250     // ms to wait after an ESC for the rest of an escape seq
+#endif
+
+#define CLI_MIN_VIEW_WIDTH                              8       // Don't scroll if less than this many chars fit after the prompt
+#define CLI_NO_OPTION                                   255     // No option matched the arg (CLI_GetOptionIndex())
+
+#ifndef CLI_SEARCH_BUFFSIZE
+ #define CLI_SEARCH_BUFFSIZE                            32      // The longest Ctrl-R search string (+1)
+#endif
+
+#ifndef CLI_READ_BUFFSIZE
+ #define CLI_READ_BUFFSIZE                              64
+#endif
+
+#ifndef CLI_WRITE_BUFFSIZE
+ #define CLI_WRITE_BUFFSIZE                             128
+#endif
+
+#ifndef CLI_THREAD_LOCAL
+ #define CLI_THREAD_LOCAL
+#endif
+
+#ifndef CLI_LOCK
+ #define CLI_LOCK()
+ #define CLI_UNLOCK()
+#endif
+
+#ifdef CLI_CMD_HASH_SIZE
+ #if (CLI_CMD_HASH_SIZE&(CLI_CMD_HASH_SIZE-1))!=0
+  #error CLI_CMD_HASH_SIZE must be a power of 2
+ #endif
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+ #ifdef CLI_CMD_HASH_SIZE
+  #error CLI_CMD_PERFECT_HASH and CLI_CMD_HASH_SIZE can not both be used
+ #endif
+ #ifndef CLI_CMDPHASH_NAMES_HASH
+  #error The CLI_CMD_PERFECT_HASH .h is from an old MakeCmdHash.py, make it again
+ #endif
+#endif
+
+#ifdef CLI_CMD_TRIE_SIZE
+ #if defined(CLI_CMD_HASH_SIZE) || defined(CLI_CMD_PERFECT_HASH)
+  #error CLI_CMD_TRIE_SIZE can not be used with CLI_CMD_HASH_SIZE or CLI_CMD_PERFECT_HASH
+ #endif
+ #if CLI_CMD_TRIE_SIZE>65535
+  #error CLI_CMD_TRIE_SIZE must be less than 65536
+ #endif
+#endif
+
+#ifdef CLI_TYPED_ARGS
+ #ifdef CLI_REMOVE_CMDHELP
+  #error CLI_TYPED_ARGS uses the help system, CLI_REMOVE_CMDHELP can not be used
+ #endif
+#endif
+
 /*** MACROS                   ***/
+#define CLI_ToLower(c)              ((c)>='A' && (c)<='Z'?(c)-'A'+'a':(c))
 
 /*** TYPE DEFINITIONS         ***/
 typedef enum
@@ -66,41 +131,199 @@ typedef enum
 {
     e_CLI_HelpState_Usage=0,
     e_CLI_HelpState_Details,
+    e_CLI_HelpState_Decode,
     e_CLI_HelpStateMAX
 } e_CLI_HelpStateType;
 
+#ifdef CLI_TYPED_ARGS
+struct CLITypedArg
+{
+    const char *Label;      // The label from CLI_CmdHelp_Arg() / CLI_CmdHelp_SubArg()
+    int32_t Value;          // The decoded value (-1 if nothing was decoded)
+    uint8_t Type;           // The e_CLIArgType from CLI_CmdHelp_ArgType()
+    uint8_t OptionCount;    // The number of options for this arg we have seen
+    uint8_t Option;         // The index of the option the arg matched (CLI_NO_OPTION if none)
+};
+#endif
+
+#ifdef CLI_CMD_TRIE_SIZE
+struct CLICmdTrieNode
+{
+    char c;                 // The char (in lower case)
+    uint16_t Cmd;           // Index+1 into g_CLICmds[] of the command that ends here (0=none)
+    uint16_t Child;         // The first node after this char (0=none)
+    uint16_t Next;          // The next node with the same parent (0=none)
+    uint16_t Count;         // The number of commands that start with the chars up to here
+};
+#endif
+
 struct CLIHandlePrv
 {
     char *LineBuff;                 // The line editing buffer
     unsigned int MaxLineSize;       // The size of 'LineBuff'
     unsigned int LineBuffInsertPos; // Where are with in the 'LineBuff'
+    unsigned int LineBuffLen;       // The number of chars in 'LineBuff' (so we don't have to STRLEN() it)
     e_CLILastKeyType LastKeyType;   // Was the last key pressed an array (up/down) key
-    char *HistoryBuff;              // The buffer we are using for the history
-    uint16_t HistoryBuffSize;       // the size of 'm_CLIHistoryBuff'
-    char *HistoryPos;               // Where are we in the history buff
+    char *HistoryBuff;              // The buffer we are using for the history (a ring of \0 terminated entries)
+    unsigned int HistoryBuffSize;   // the size of 'HistoryBuff'
+    unsigned int HistoryHead;       // The offset of the oldest entry in 'HistoryBuff'
+    unsigned int HistoryTail;       // The offset where the next entry goes in 'HistoryBuff'
+    unsigned int HistoryUsed;       // The number of bytes in use in 'HistoryBuff'
+    unsigned int HistoryCount;      // The number of entries in 'HistoryBuff'
+    unsigned int HistoryIndex;      // The entry we are on (0=oldest, 'HistoryCount'=past the newest)
+    unsigned int HistoryPos;        // The offset of the entry at 'HistoryIndex' ('HistoryTail' if past the newest)
+#ifdef CLI_HISTORY_DEDUP_SIZE
+    uint16_t HistoryDups[CLI_HISTORY_DEDUP_SIZE]; // The number of entries with each hash (to find dups)
+    unsigned int HistoryDupPos[CLI_HISTORY_DEDUP_SIZE]; // The offset of the newest entry with each hash
+#endif
     bool PasswordMode;              // Are we asking for a password
-    uint8_t ESCPos;                 // The pos in the ANSI escape seq we have gotten
+    bool ANSIMode;                  // Can we use ANSI cursor commands to redraw the line
+    unsigned int TermWidth;         // The number of columns on the terminal (0=unknown, no scrolling)
+    unsigned int ViewStart;         // The first char of the line buffer on the screen (when scrolled)
+    unsigned int ViewDrawn;         // The number of chars on the screen from 'ViewStart' (when scrolled)
+    struct CLIESCDecoder ESC;       // Decodes the ANSI escape seq's
     uint32_t ESCStart;              // The time that the ESC key was pressed
+    bool Pasting;                   // Are we in a bracketed paste (ESC[200~ to ESC[201~)
+    bool Burst;                     // More input is waiting so hold off on echoing inserted chars
+    unsigned int BurstPos;          // Where the chars that haven't been echoed start
+    unsigned int BurstCount;        // The number of inserted chars that haven't been echoed
+    bool PromptPending;             // We ran lines from a paste and haven't drawn the prompt yet
+    bool Searching;                 // Are we in a Ctrl-R history search
+    bool SearchFailed;              // The search string wasn't found
+    unsigned int SearchLen;         // The number of chars in 'SearchStr'
+    unsigned int SearchWidth;       // The number of chars the search put on the screen line
+    char SearchStr[CLI_SEARCH_BUFFSIZE]; // What we are searching the history for
     const char *Prompt;             // The command prompt string
     const struct CLICommand *RunningCmd;    // The command we are currently running (used by the help system)
     unsigned int ArgsOutput;        // How many args have to output so far (used for indenting)
     e_CLI_HelpStateType HelpState;  // What is the help system currently doing
     bool FirstOption;               // Is this the first option we are outputing
+#ifdef CLI_TYPED_ARGS
+    int DecodeArgc;                 // The argc of the command we are decoding the args of
+    const char **DecodeArgv;        // The argv of the command we are decoding the args of
+    unsigned int DecodeArg;         // The argv index of the last CLI_CmdHelp_Arg() / SubArg() (0=not one we are decoding)
+    unsigned int DecodeSubArg;      // The argv index of the next CLI_CmdHelp_SubArg() (0=the last option didn't match)
+    struct CLITypedArg TypedArgs[CLI_TYPED_ARGS];// The decoded args (argv[1] is [0])
+#endif
+
+    struct CLIHandlePrv *NextFree;  // The next prompt in the free list (when this prompt is freed)
+#ifdef CLI_MALLOC
+    const char **Argv;              // The argv arena we build the args for a command in (NULL until the first command)
+    unsigned int ArgvSize;          // The number of pointers in 'Argv'
+    bool ArgvInUse;                 // Is a command running with 'Argv' (a command that runs a line on the same prompt gets it's own)
+    char *AllocBuff;                // The line / history buffer we allocated with CLI_AllocBuffers() (NULL if none)
+#endif
+
+#ifdef CLI_READ
+    char ReadBuff[CLI_READ_BUFFSIZE];   // The last block of chars we read with CLI_READ()
+    unsigned int ReadBuffLen;       // The number of bytes in 'ReadBuff'
+    unsigned int ReadBuffPos;       // The next byte in 'ReadBuff' to process
+#endif
+#ifdef CLI_WRITE
+    char WriteBuff[CLI_WRITE_BUFFSIZE]; // Output that is waiting to go out with CLI_WRITE()
+    unsigned int WriteBuffLen;      // The number of bytes in 'WriteBuff'
+#endif
 };
 
 /*** FUNCTION PROTOTYPES      ***/
+static char *CLI_ProcessInputChar(struct CLIHandlePrv *CLI,unsigned char c);
+static void CLI_HandleESCTimeout(struct CLIHandlePrv *CLI);
+static void CLI_HandleKey(struct CLIHandlePrv *CLI,e_CLIKeyType Key);
 static void CLI_EchoEndOfPromptLine(struct CLIHandlePrv *CLI,unsigned int len);
 static void CLI_EraseCurrentLine(struct CLIHandlePrv *CLI);
 static void CLI_ResetHistory(struct CLIHandlePrv *CLI);
+static bool CLI_AddToHistory(struct CLIHandlePrv *CLI,const char *Line,
+        unsigned int LineLen);
+#ifdef CLI_HISTORY_DEDUP_SIZE
+static uint32_t CLI_HashHistoryLine(const char *Line);
+static bool CLI_HistoryEntryIs(struct CLIHandlePrv *CLI,unsigned int Pos,
+        const char *Line,unsigned int Len);
+static void CLI_RemoveHistoryEntry(struct CLIHandlePrv *CLI,unsigned int Pos,
+        unsigned int Len);
+#endif
+static void CLI_HistoryPrev(struct CLIHandlePrv *CLI);
+static void CLI_HistoryNext(struct CLIHandlePrv *CLI);
+static unsigned int CLI_CopyHistoryEntry(struct CLIHandlePrv *CLI);
+static void CLI_ShowHistoryEntry(struct CLIHandlePrv *CLI);
+static void CLI_SendCSI(struct CLIHandlePrv *CLI,unsigned int Count,char Cmd);
+static unsigned int CLI_CSISize(unsigned int Count);
+static void CLI_CursorLeft(struct CLIHandlePrv *CLI,unsigned int Count);
+static void CLI_CursorRight(struct CLIHandlePrv *CLI,unsigned int From,
+        unsigned int Count);
+static void CLI_EchoChars(struct CLIHandlePrv *CLI,unsigned int From,
+        unsigned int To);
+static void CLI_RedrawLineFrom(struct CLIHandlePrv *CLI,unsigned int Cursor,
+        unsigned int Same,unsigned int OldLen);
+static unsigned int CLI_ViewWidth(struct CLIHandlePrv *CLI);
+static bool CLI_NeedView(struct CLIHandlePrv *CLI,unsigned int OldLen);
+static void CLI_RedrawView(struct CLIHandlePrv *CLI,unsigned int Cursor,
+        unsigned int Same,unsigned int OldLen,unsigned int Width);
+static void CLI_MoveCaret(struct CLIHandlePrv *CLI,unsigned int Pos);
+static void CLI_DeleteCharOnScreen(struct CLIHandlePrv *CLI);
+static void CLI_FlushBurst(struct CLIHandlePrv *CLI);
+static void CLI_RedrawPromptLine(struct CLIHandlePrv *CLI);
+static void CLI_StartSearch(struct CLIHandlePrv *CLI);
+static void CLI_EndSearch(struct CLIHandlePrv *CLI);
+static bool CLI_SearchInputChar(struct CLIHandlePrv *CLI,unsigned char c);
+static void CLI_SearchHistory(struct CLIHandlePrv *CLI,bool Older);
+static bool CLI_HistoryEntryHas(struct CLIHandlePrv *CLI,unsigned int Pos);
+static void CLI_DrawSearch(struct CLIHandlePrv *CLI);
+static unsigned int CLI_PrintClipped(struct CLIHandlePrv *CLI,const char *Str,
+        unsigned int Room);
+static unsigned int CLI_PrintHistoryEntry(struct CLIHandlePrv *CLI,
+        unsigned int Pos,unsigned int Room);
+static void CLI_ClearSearchLine(struct CLIHandlePrv *CLI,unsigned int Width);
 static void CLI_ResetInputBuffer(struct CLIHandlePrv *CLI);
-static void CLIPrintStr(const char *Str);
+static void CLIPrintStr(struct CLIHandlePrv *CLI,const char *Str);
+static void CLI_PutChar(struct CLIHandlePrv *CLI,char c);
+static void CLI_FlushOutput(struct CLIHandlePrv *CLI);
 static void CLI_RunCMD(struct CLIHandlePrv *CLI,char *Line,const struct CLICommand *Cmd);
+#ifdef CLI_TYPED_ARGS
+static bool CLI_DecodeArgs(struct CLIHandlePrv *CLI,int Argc,const char **Argv);
+static void CLI_SetDecodeArg(unsigned int Arg,const char *Label);
+static void CLI_DecodeOption(int Level,const char *Option);
+static bool CLI_DecodeNumber(const char *Str,bool Hex,int32_t *Value);
+#endif
+static const struct CLICommand *CLI_FindCmd(const char *Line);
+#if defined(CLI_CMD_HASH_SIZE) || defined(CLI_CMD_PERFECT_HASH)
+static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len);
+#endif
+#ifdef CLI_CMD_PERFECT_HASH
+static uint32_t CLI_MixCmdHash(uint32_t Hash);
+static void CLI_CheckCmdPHash(void);
+#endif
+#ifdef CLI_CMD_HASH_SIZE
+static void CLI_BuildCmdHash(void);
+#endif
+#ifdef CLI_CMD_TRIE_SIZE
+static void CLI_BuildCmdTrie(void);
+static unsigned int CLI_CmdTrieChild(unsigned int Node,char c);
+static const struct CLICmdTrieNode *CLI_FindCmdTrieNode(const char *Str,
+        unsigned int Len);
+static unsigned int CLI_GetCmdTrieCmd(const struct CLICmdTrieNode *Node,
+        unsigned int Nth);
+#endif
 void CLI_OutputHelpDesc(unsigned int Indent,const char *Label,const char *Desc);
 
 /*** VARIABLE DEFINITIONS     ***/
-static uint8_t m_CLI_AllocatedPrompts;
+static unsigned int m_CLI_AllocatedPrompts;
+static struct CLIHandlePrv *m_CLI_FreePrompts;
 static struct CLIHandlePrv m_CLI_Prompts[CLI_MAX_PROMPTS];
-static struct CLIHandlePrv *g_CLI_ActiveCLI;
+static CLI_THREAD_LOCAL struct CLIHandlePrv *g_CLI_ActiveCLI;   // The prompt running a command (used by the help system)
+#ifdef CLI_CMD_HASH_SIZE
+static uint16_t m_CLI_CmdHash[CLI_CMD_HASH_SIZE];       // Index+1 into g_CLICmds[] for this slot (0=empty)
+static uint32_t m_CLI_CmdHashValue[CLI_CMD_HASH_SIZE];  // The hash of the command in this slot
+static unsigned int m_CLI_CmdHashCount;                 // The g_CLICmdsCount the index was built for
+static bool m_CLI_CmdHashOK;                            // Can we use the index (false=scan g_CLICmds[])
+#endif
+#ifdef CLI_CMD_PERFECT_HASH
+static bool m_CLI_CmdPHashOK;                           // Were the perfect hash tables made for this g_CLICmds[] (false=scan g_CLICmds[])
+#endif
+#ifdef CLI_CMD_TRIE_SIZE
+static struct CLICmdTrieNode m_CLI_CmdTrie[CLI_CMD_TRIE_SIZE];  // The command name trie (0 is the root)
+static unsigned int m_CLI_CmdTrieCount;                 // The g_CLICmdsCount the trie was built for
+static bool m_CLI_CmdTrieOK;                            // Can we use the trie (false=scan g_CLICmds[])
+#endif
 
 /*******************************************************************************
  * NAME:
@@ -115,9 +338,9 @@ static struct CLIHandlePrv *g_CLI_ActiveCLI;
  * FUNCTION:
  *    This function gets the next available CLI handle.  This is like an
  *    allocate function except it doesn't allocate memory and just takes
- *    from a pool.  When the pool is empty it return NULL.
- *
- *    There is no way to free a prompt.
+ *    from a pool.  Prompts given back with CLI_FreeHandle() are reused
+ *    first.  When the pool is empty it returns NULL (or if CLI_MALLOC() is
+ *    defined the prompt is allocated with it).
  *
  * RETURNS:
  *    A handle to the prompt or NULL if there are no more available
@@ -137,10 +360,113 @@ static struct CLIHandlePrv *g_CLI_ActiveCLI;
  ******************************************************************************/
 struct CLIHandle *CLI_GetHandle(void)
 {
-    if(m_CLI_AllocatedPrompts>=CLI_MAX_PROMPTS)
+    struct CLIHandlePrv *CLI;
+
+    CLI_LOCK();
+    if(m_CLI_FreePrompts!=NULL)
+    {
+        /* Reuse a prompt that was freed */
+        CLI=m_CLI_FreePrompts;
+        m_CLI_FreePrompts=CLI->NextFree;
+    }
+    else if(m_CLI_AllocatedPrompts<CLI_MAX_PROMPTS)
+    {
+        CLI=&m_CLI_Prompts[m_CLI_AllocatedPrompts++];
+#ifdef CLI_MALLOC
+        CLI->Argv=NULL;
+        CLI->ArgvSize=0;
+        CLI->ArgvInUse=false;
+#endif
+    }
+    else
+    {
+#ifdef CLI_MALLOC
+        /* The pool is used up, grow it */
+        CLI=CLI_MALLOC(sizeof(struct CLIHandlePrv));
+        if(CLI!=NULL)
+        {
+            CLI->Argv=NULL;
+            CLI->ArgvSize=0;
+            CLI->ArgvInUse=false;
+        }
+#else
+        CLI=NULL;
+#endif
+    }
+    CLI_UNLOCK();
+
+    if(CLI==NULL)
         return NULL;
 
-    return (struct CLIHandle *)&m_CLI_Prompts[m_CLI_AllocatedPrompts++];
+#ifdef CLI_MALLOC
+    CLI->AllocBuff=NULL;
+#endif
+
+    return (struct CLIHandle *)CLI;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FreeHandle
+ *
+ * SYNOPSIS:
+ *    void CLI_FreeHandle(struct CLIHandle *Handle);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to free
+ *
+ * FUNCTION:
+ *    This function gives a handle back to the pool so it can be handed out
+ *    again by CLI_GetHandle().  If ANSI mode is on the terminal is asked to
+ *    stop bracketed paste (see CLI_SetANSIMode()).  The prompt is put on a
+ *    free list so this and the next CLI_GetHandle() are O(1).
+ *
+ *    If the line / history buffers were allocated with CLI_AllocBuffers()
+ *    they are freed (with CLI_FREE()).  Buffers you set yourself with
+ *    CLI_SetLineBuffer() / CLI_SetHistoryBuffer() are still yours.
+ *
+ *    Handles that were allocated with CLI_MALLOC() are kept on the free
+ *    list and not given back to CLI_FREE().  The argv arena stays with the
+ *    prompt (it is used again when the prompt is).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_GetHandle(), CLI_AllocBuffers()
+ ******************************************************************************/
+void CLI_FreeHandle(struct CLIHandle *Handle)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+
+    if(CLI==NULL)
+        return;
+
+    /* Put the terminal back out of bracketed paste */
+    if(CLI->ANSIMode)
+    {
+        CLIPrintStr(CLI,"\33[?2004l");
+        CLI_FlushOutput(CLI);
+        CLI->ANSIMode=false;
+    }
+
+#ifdef CLI_MALLOC
+    if(CLI->AllocBuff!=NULL)
+        CLI_FREE(CLI->AllocBuff);
+    CLI->AllocBuff=NULL;
+#endif
+    CLI->LineBuff=NULL;
+    CLI->MaxLineSize=0;
+    CLI->HistoryBuff=NULL;
+    CLI->HistoryBuffSize=0;
+
+    if(g_CLI_ActiveCLI==CLI)
+        g_CLI_ActiveCLI=NULL;
+
+    CLI_LOCK();
+    CLI->NextFree=m_CLI_FreePrompts;
+    m_CLI_FreePrompts=CLI;
+    CLI_UNLOCK();
 }
 
 /*******************************************************************************
@@ -170,14 +496,46 @@ void CLI_InitPrompt(struct CLIHandle *Handle)
     CLI->LineBuff=NULL;
     CLI->MaxLineSize=0;
     CLI->LineBuffInsertPos=0;
+    CLI->LineBuffLen=0;
     CLI->LastKeyType=e_CLILastKey_Other;
     CLI->HistoryBuff=NULL;
     CLI->HistoryBuffSize=0;
-    CLI->HistoryPos=NULL;
     CLI->PasswordMode=false;
-    CLI->ESCPos=0;
+    CLI->ANSIMode=false;
+    CLI->TermWidth=0;
+    CLI->ViewStart=0;
+    CLI->ViewDrawn=0;
+    CLI->ESC.State=e_CLIESC_Idle;
     CLI->ESCStart=0;
+    CLI->Pasting=false;
+    CLI->Burst=false;
+    CLI->BurstPos=0;
+    CLI->BurstCount=0;
+    CLI->PromptPending=false;
+    CLI->Searching=false;
+    CLI->SearchFailed=false;
+    CLI->SearchLen=0;
+    CLI->SearchWidth=0;
+    CLI->SearchStr[0]=0;
     CLI->Prompt=">";
+    CLI->RunningCmd=NULL;
+#ifdef CLI_READ
+    CLI->ReadBuffLen=0;
+    CLI->ReadBuffPos=0;
+#endif
+#ifdef CLI_WRITE
+    CLI->WriteBuffLen=0;
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+    CLI_CheckCmdPHash();
+#endif
+#ifdef CLI_CMD_HASH_SIZE
+    CLI_BuildCmdHash();
+#endif
+#ifdef CLI_CMD_TRIE_SIZE
+    CLI_BuildCmdTrie();
+#endif
 }
 
 /*******************************************************************************
@@ -193,6 +551,18 @@ void CLI_InitPrompt(struct CLIHandle *Handle)
  * FUNCTION:
  *    This function gets an input line from the user.  It is non-blocking.
  *
+ *    If CLI_READ() is defined in the options then this will read a block
+ *    of bytes at a time and process all of them in one call (stopping early
+ *    only when a line is finished, the rest of the block is kept for the
+ *    next call).  If not, then it will process chars using
+ *    CLI_IS_CHAR_AVAILABLE() / CLI_GETCHAR() for as long as there are more
+ *    waiting (up to a line's worth).
+ *
+ *    When more chars are waiting (or we are in a bracketed paste) the echo
+ *    of inserted chars is held back and done in one go at the end.
+ *
+ *    Any output (echo) is flushed before this returns.
+ *
  * RETURNS:
  *    A pointer to the line buffer or NULL if the line is not ready yet.
  *
@@ -202,374 +572,500 @@ void CLI_InitPrompt(struct CLIHandle *Handle)
 char *CLI_GetLine(struct CLIHandle *Handle)
 {
     struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
-    unsigned char c;
-    unsigned int p;
-    unsigned int l;
-    unsigned int bytes;
-    char *h;    // History buffer pointer
+    char *Line;
+#ifdef CLI_READ
+    int Bytes;
+#else
+    unsigned int r;
+    char c;
+#endif
 
-    c=0;
+    Line=NULL;
 
-    /* If we got a ESC we wait 1/4 second for a second char and if we don't
-       get one assume this was really an ESC (and not an escape seq) */
-    if(CLI->ESCPos>0)
-    {
-        if(CLI_GET_MILLISEC_COUNTER()-CLI->ESCStart>250)
-            c=27;
-    }
+#ifdef CLI_READ
+    /* If we have used up the last block, read in the next one */
+    if(CLI->ReadBuffPos>=CLI->ReadBuffLen)
+    {
+        CLI->ReadBuffPos=0;
+        CLI->ReadBuffLen=0;
+        Bytes=CLI_READ(CLI->ReadBuff,sizeof(CLI->ReadBuff));
+        if(Bytes>0)
+            CLI->ReadBuffLen=Bytes;
+#ifdef CLI_ESC_BURST
+        else if(CLI->ESC.State==e_CLIESC_ESC)
+            CLI_HandleESCTimeout(CLI);  // Nothing came after the ESC, it was the ESC key
+#endif
+    }
+
+    /* Process the whole block (unless we finish a line) */
+    while(CLI->ReadBuffPos<CLI->ReadBuffLen && Line==NULL)
+    {
+        CLI->Burst=CLI->Pasting || CLI->ReadBuffPos+1<CLI->ReadBuffLen;
+        Line=CLI_ProcessInputChar(CLI,CLI->ReadBuff[CLI->ReadBuffPos++]);
+    }
+#else
+    /* Keep going while there is more waiting (a paste) */
+    for(r=0;r<CLI->MaxLineSize && Line==NULL && CLI_IS_CHAR_AVAILABLE();r++)
+    {
+        c=CLI_GETCHAR();
+        CLI->Burst=CLI->Pasting || CLI_IS_CHAR_AVAILABLE();
+        Line=CLI_ProcessInputChar(CLI,c);
+        if(!CLI->Burst)
+            break;
+    }
+#endif
+    CLI->Burst=false;
+    CLI_FlushBurst(CLI);
+
+#if defined(CLI_ESC_BURST) && !defined(CLI_READ)
+    /* The rest of an escape seq comes in with the ESC, so if nothing is
+       waiting after it, it was the ESC key */
+    if(CLI->ESC.State==e_CLIESC_ESC && !CLI_IS_CHAR_AVAILABLE())
+        CLI_HandleESCTimeout(CLI);
+#endif
+
+    /* If we got a ESC we wait CLI_ESC_TIMEOUT (1/4 second by default) for the
+       next char and if we don't get one assume this was really an ESC (and
+       not an escape seq) */
+    if(CLI->ESC.State!=e_CLIESC_Idle && CLI_GET_MILLISEC_COUNTER()-CLI->ESCStart>CLI_ESC_TIMEOUT)
+        CLI_HandleESCTimeout(CLI);
 
-    if(CLI_IS_CHAR_AVAILABLE() || c!=0)
-    {
-        if(c==0)
-            c=CLI_GETCHAR();
+    CLI_FlushOutput(CLI);
+
+    return Line;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetNextWakeup
+ *
+ * SYNOPSIS:
+ *    uint32_t CLI_GetNextWakeup(struct CLIHandle *Handle);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *
+ * FUNCTION:
+ *    This function returns how long the prompt can be left alone if no new
+ *    input comes in.  The main loop can use this to sleep (poll(), WFI, etc)
+ *    instead of calling CLI_RunCmdPrompt() over and over.
+ *
+ *    The only thing the prompt times is the ESC key (it waits
+ *    CLI_ESC_TIMEOUT after an ESC to see if it is the start of an escape
+ *    seq).  It also
+ *    returns 0 if there are bytes left over from the last CLI_READ() block.
+ *
+ * RETURNS:
+ *    The number of milli seconds until CLI_RunCmdPrompt() (or CLI_GetLine())
+ *    needs to be called again, 0 if it needs to be called right away, or
+ *    CLI_WAIT_FOREVER if it only needs to be called when there is new input.
+ *
+ * SEE ALSO:
+ *    CLI_WaitForInput(), CLI_GetLine()
+ ******************************************************************************/
+uint32_t CLI_GetNextWakeup(struct CLIHandle *Handle)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+    uint32_t Elapsed;
+
+#ifdef CLI_READ
+    /* We still have input left over from the last block */
+    if(CLI->ReadBuffPos<CLI->ReadBuffLen)
+        return 0;
+#endif
+
+#if defined(CLI_ESC_BURST) && defined(CLI_READ)
+    /* The next read tells us if the ESC was the ESC key */
+    if(CLI->ESC.State==e_CLIESC_ESC)
+        return 0;
+#endif
+
+    if(CLI->ESC.State!=e_CLIESC_Idle)
+    {
+        Elapsed=CLI_GET_MILLISEC_COUNTER()-CLI->ESCStart;
+        if(Elapsed>CLI_ESC_TIMEOUT)
+            return 0;
+        return CLI_ESC_TIMEOUT+1-Elapsed;
+    }
+
+    return CLI_WAIT_FOREVER;
+}
+
+#ifdef CLI_WAIT_FOR_INPUT
+/*******************************************************************************
+ * NAME:
+ *    CLI_WaitForInput
+ *
+ * SYNOPSIS:
+ *    bool CLI_WaitForInput(struct CLIHandle *Handle,uint32_t Timeout);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Timeout [I] -- The max number of milli seconds to wait for.  Use
+ *                   CLI_WAIT_FOREVER to wait until there is input.
+ *
+ * FUNCTION:
+ *    This function blocks until there is input for the prompt (using
+ *    CLI_WAIT_FOR_INPUT()), the timeout runs out, or the prompt has
+ *    something it needs to time out (the ESC key).  This lets the main loop
+ *    sleep instead of spinning on CLI_RunCmdPrompt():
+ *
+ *        while(!quit)
+ *        {
+ *            CLI_WaitForInput(Prompt,CLI_WAIT_FOREVER);
+ *            CLI_RunCmdPrompt(Prompt);
+ *        }
+ *
+ *    If you need to wait on other things as well then use
+ *    CLI_GetNextWakeup() to get the timeout for your own wait instead.
+ *
+ * RETURNS:
+ *    true -- There is input ready (or the prompt has work to do).
+ *    false -- We timed out.
+ *
+ * SEE ALSO:
+ *    CLI_GetNextWakeup(), CLI_RunCmdPrompt()
+ ******************************************************************************/
+bool CLI_WaitForInput(struct CLIHandle *Handle,uint32_t Timeout)
+{
+    uint32_t Wakeup;
+
+    Wakeup=CLI_GetNextWakeup(Handle);
+    if(Wakeup==0)
+        return true;
+
+    if(Wakeup<Timeout)
+        Timeout=Wakeup;
+
+    return CLI_WAIT_FOR_INPUT(Timeout);
+}
+#endif
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HandleESCTimeout
+ *
+ * SYNOPSIS:
+ *    static void CLI_HandleESCTimeout(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This is helper function for the CLI_GetLine() function.  It is called
+ *    when we have been waiting too long for the rest of an escape seq.
+ *    If we only got the ESC then the user really pressed ESC (and we clear
+ *    the line), otherwise we just drop the partial seq.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_GetLine()
+ ******************************************************************************/
+static void CLI_HandleESCTimeout(struct CLIHandlePrv *CLI)
+{
+    /* Just an ESC, the user pressed the ESC key */
+    if(CLI->ESC.State==e_CLIESC_ESC)
+        CLI_HandleKey(CLI,e_CLIKey_Esc);
+    CLI->ESC.State=e_CLIESC_Idle;
+}
 
-        if(CLI->ESCPos>0)
+/*******************************************************************************
+ * NAME:
+ *    CLI_ProcessInputChar
+ *
+ * SYNOPSIS:
+ *    static char *CLI_ProcessInputChar(struct CLIHandlePrv *CLI,
+ *              unsigned char c);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    c [I] -- The char that was input.
+ *
+ * FUNCTION:
+ *    This is helper function for the CLI_GetLine() function.  It processes
+ *    one input char (editing the line, history, and escape seq's).
+ *
+ * RETURNS:
+ *    A pointer to the line buffer if this char finished the line or NULL
+ *    if the line is not ready yet.
+ *
+ * SEE ALSO:
+ *    CLI_GetLine()
+ ******************************************************************************/
+static char *CLI_ProcessInputChar(struct CLIHandlePrv *CLI,unsigned char c)
+{
+    unsigned int l;
+    e_CLIKeyType Key;
+
+    /* Tabs in a paste are just white space */
+    if(CLI->Pasting && c==9)
+        c=' ';
+
+    /* Anything but a plain char needs the screen up to date first */
+    if(CLI->BurstCount>0 && (CLI->ESC.State!=e_CLIESC_Idle || c<' ' ||
+            c==127 || c==255))
+        CLI_FlushBurst(CLI);
+
+    if(CLI->Searching && CLI_SearchInputChar(CLI,c))
+        return NULL;
+
+    if(CLI->ESC.State!=e_CLIESC_Idle)
+    {
+        Key=CLI_ESC_Decode(&CLI->ESC,c);
+        if(Key!=e_CLIKey_NotESC)
         {
-            CLI->ESCPos++;
-            switch(CLI->ESCPos)
-            {
-                case 1: // ESC Char
-                break;
-                case 2: // [
-                    if(c!='[')
-                    {
-                        /* Not ANSI */
-                        CLI->ESCPos=0;
-                    }
-                    if(c==27)
-                    {
-                        /* ESC again */
-                        CLI_EraseCurrentLine(CLI);
-                        CLI_ResetInputBuffer(CLI);
-                    }
-                break;
-                case 3:
-                    switch(c)
-                    {
-                        case 'C':   // Right
-                            if(CLI->LineBuffInsertPos<STRLEN(CLI->LineBuff))
-                            {
-                                if(CLI->PasswordMode)
-                                {
-                                    CLI_PUTCHAR('*');
-                                }
-                                else
-                                {
-                                    CLI_PUTCHAR(CLI->
-                                            LineBuff[CLI->LineBuffInsertPos]);
-                                }
-                                CLI->LineBuffInsertPos++;
-                            }
-                            CLI->ESCPos=0;
-                        break;
-                        case 'D':   // Left
-                            if(CLI->LineBuffInsertPos>0)
-                                CLI->LineBuffInsertPos--;
-                            CLI_PUTCHAR('\b');
-                            CLI->ESCPos=0;
-                        break;
-                        case '4':   // End
-                            for(;CLI->LineBuff[CLI->LineBuffInsertPos]!=0;
-                                    CLI->LineBuffInsertPos++)
-                            {
-                                if(CLI->PasswordMode)
-                                {
-                                    CLI_PUTCHAR('*');
-                                }
-                                else
-                                {
-                                    CLI_PUTCHAR(CLI->
-                                            LineBuff[CLI->LineBuffInsertPos]);
-                                }
-                            }
-                        break;
-                        case '3':   // Del
-                            l=STRLEN(CLI->LineBuff);
-                            if(CLI->LineBuffInsertPos<l)
-                            {
-                                /* Copy the char above the current pos */
-                                for(p=CLI->LineBuffInsertPos;p<l;p++)
-                                    CLI->LineBuff[p]=CLI->LineBuff[p+1];
-
-                                CLI_EchoEndOfPromptLine(CLI,l-1);
-                            }
-                        break;
-                        case '1':   // Home
-                            for(;CLI->LineBuffInsertPos>0;
-                                    CLI->LineBuffInsertPos--)
-                            {
-                                CLI_PUTCHAR('\b');
-                            }
-                        break;
-                        case 'A':   // Up
-                            if(CLI->HistoryBuff!=NULL)
-                            {
-                                CLI_EraseCurrentLine(CLI);
-
-                                p=1;
-                                /* If the last key was down and we wheren't
-                                   at the end of the history then we need to
-                                   skip one */
-                                if(CLI->LastKeyType==e_CLILastKey_Down)
-                                {
-                                    if(CLI->HistoryPos<
-                                        CLI->HistoryBuff+CLI->HistoryBuffSize-1)
-                                    {
-                                        if(*(CLI->HistoryPos+1)!=0)
-                                        {
-                                            /* We need to skip an entry */
-                                            p=2;
-                                        }
-                                    }
-                                }
-
-                                /* Find the prev entry in the history */
-                                while(CLI->HistoryPos>CLI->HistoryBuff)
-                                {
-                                    if(*(CLI->HistoryPos-1)==0)
-                                    {
-                                        if(--p==0)
-                                            break;
-                                    }
-                                    CLI->HistoryPos--;
-                                }
-                                strcpy(CLI->LineBuff,CLI->HistoryPos);
-
-                                /* Move to the end of the prev entry if we
-                                   can */
-                                if(CLI->HistoryPos>CLI->HistoryBuff)
-                                    CLI->HistoryPos--;
-
-                                l=STRLEN(CLI->LineBuff);
-                                for(CLI->LineBuffInsertPos=0;
-                                        CLI->LineBuffInsertPos<l;
-                                        CLI->LineBuffInsertPos++)
-                                {
-                                    if(CLI->PasswordMode)
-                                    {
-                                        CLI_PUTCHAR('*');
-                                    }
-                                    else
-                                    {
-                                        CLI_PUTCHAR(CLI->LineBuff[
-                                                CLI->LineBuffInsertPos]);
-                                    }
-                                }
-                            }
-                            CLI->LastKeyType=e_CLILastKey_Up;
-                            CLI->ESCPos=0;
-                        break;
-                        case 'B':   // Down
-                            if(CLI->HistoryBuff!=NULL)
-                            {
-                                CLI_EraseCurrentLine(CLI);
-
-                                /* Find the next entry in the history */
-                                if(*(CLI->HistoryPos+1)!=0)
-                                {
-                                    if(CLI->HistoryPos!=CLI->HistoryBuff)
-                                        CLI->HistoryPos++;
-
-                                    if(CLI->LastKeyType==e_CLILastKey_Up)
-                                    {
-                                        /* Last key was up, we need to skip
-                                           an entry */
-                                        CLI->HistoryPos=
-                                                strchr(CLI->HistoryPos+1,0);
-                                        if(*(CLI->HistoryPos+1)!=0)
-                                            CLI->HistoryPos++;
-                                    }
-                                }
-
-                                strcpy(CLI->LineBuff,CLI->HistoryPos);
-
-                                l=STRLEN(CLI->LineBuff);
-                                for(CLI->LineBuffInsertPos=0;
-                                        CLI->LineBuffInsertPos<l;
-                                        CLI->LineBuffInsertPos++)
-                                {
-                                    if(CLI->PasswordMode)
-                                    {
-                                        CLI_PUTCHAR('*');
-                                    }
-                                    else
-                                    {
-                                        CLI_PUTCHAR(CLI->LineBuff[
-                                                CLI->LineBuffInsertPos]);
-                                    }
-
-                                    /* Drag 'CLI->CLIHistoryPos' with us */
-                                    CLI->HistoryPos++;
-                                }
-                            }
-                            CLI->LastKeyType=e_CLILastKey_Down;
-                            CLI->ESCPos=0;
-                        break;
-                        default:
-                            CLI->ESCPos=0;
-                        break;
+            CLI_HandleKey(CLI,Key);
+            return NULL;
+        }
+    }
+
+    switch(c)
+    {
+        case 0:     // We ignore 0's
+        break;
+        case 9:     /* Tab */
+        break;
+        case 10:    // No new lines please
+        break;
+        case 18:    // Ctrl-R (search the history)
+            if(CLI->HistoryBuff!=NULL && !CLI->PasswordMode)
+            {
+                CLI_StartSearch(CLI);
+            }
+        break;
+        case 27:    /* ANSI codes */
+            CLI_ESC_Start(&CLI->ESC);
+            CLI->ESCStart=CLI_GET_MILLISEC_COUNTER();
+        break;
+        case '\r':
+            /* We are done */
+            CLI_PutChar(CLI,'\n');
+            CLI_PutChar(CLI,'\r');
+
+            /* Add to the end of the history buffer (if we have one,
+               it's not a blank line, and the last key was not an
+               arrow) */
+            if(CLI->HistoryBuff!=NULL && *CLI->LineBuff!=0)
+            {
+                if(CLI->LastKeyType==e_CLILastKey_Other)
+                {
+#ifdef CLI_HISTORY_SAVE
+                    if(CLI_AddToHistory(CLI,CLI->LineBuff,CLI->LineBuffLen))
+                    {
+                        CLI_HISTORY_SAVE((struct CLIHandle *)CLI,CLI->LineBuff,
+                                CLI->LineBuffLen);
+                    }
+#else
+                    CLI_AddToHistory(CLI,CLI->LineBuff,CLI->LineBuffLen);
+#endif
+                }
+                else
+                {
+                    /* We ran an entry from the history, stay just after
+                       it (so up gives it to us again) */
+                    if(CLI->HistoryIndex<CLI->HistoryCount)
+                        CLI_HistoryNext(CLI);
+                }
+            }
+            CLI->LastKeyType=e_CLILastKey_Other;
+            return CLI->LineBuff;
+        break;
+        case '\b':
+        case 127:
+            if(CLI->LineBuffInsertPos>0)
+            {
+                CLI->LineBuffInsertPos--;
+
+                /* Copy the chars above the current pos down (with the
+                   \0) */
+                l=CLI->LineBuffLen;
+                memmove(&CLI->LineBuff[CLI->LineBuffInsertPos],
+                        &CLI->LineBuff[CLI->LineBuffInsertPos+1],
+                        l-CLI->LineBuffInsertPos);
+                CLI->LineBuffLen--;
+
+                if(CLI_NeedView(CLI,l))
+                {
+                    CLI_RedrawLineFrom(CLI,CLI->LineBuffInsertPos+1,
+                            CLI->LineBuffInsertPos,l);
+                }
+                else
+                {
+                    /* Move over the char we just deleted, then redraw
+                       the end of the line */
+                    CLI_PutChar(CLI,'\b');
+                    CLI_DeleteCharOnScreen(CLI);
+                }
+            }
+            CLI->LastKeyType=e_CLILastKey_Other;
+        break;
+        default:
+            l=CLI->LineBuffLen;
+            if(l<CLI->MaxLineSize-1)
+            {
+                /* Make room (move the \0 as well) */
+                memmove(&CLI->LineBuff[CLI->LineBuffInsertPos+1],
+                        &CLI->LineBuff[CLI->LineBuffInsertPos],
+                        l-CLI->LineBuffInsertPos+1);
+                CLI->LineBuff[CLI->LineBuffInsertPos]=c;
+                CLI->LineBuffLen++;
+
+                if(CLI->Burst || CLI->BurstCount>0)
+                {
+                    /* There's more waiting, echo them all in one go
+                       when we are done (CLI_FlushBurst()) */
+                    if(CLI->BurstCount==0)
+                        CLI->BurstPos=CLI->LineBuffInsertPos;
+                    CLI->BurstCount++;
+                    CLI->LineBuffInsertPos++;
+                }
+                else if(CLI_NeedView(CLI,l))
+                {
+                    CLI->LineBuffInsertPos++;
+                    CLI_RedrawLineFrom(CLI,CLI->LineBuffInsertPos-1,
+                            CLI->LineBuffInsertPos-1,l);
+                }
+                else
+                {
+                    if(CLI->ANSIMode)
+                    {
+                        /* Open up a space for the new char (if we are
+                           not at the end) */
+                        if(CLI->LineBuffInsertPos<l)
+                            CLI_SendCSI(CLI,1,'@');
                     }
-                    c=0;
-                break;
-                case 4:
-                    if(c=='~')
-                        c=0;
-                    CLI->ESCPos=0;
-                break;
-                default:
-                    CLI->ESCPos=0;
-                break;
-            }
-        }
-
-        if(CLI->ESCPos==0)
-        {
-            switch(c)
-            {
-                case 0:     // We ignore 0's
-                break;
-                case 9:     /* Tab */
-                break;
-                case 10:    // No new lines please
-                break;
-                case 27:    /* ANSI codes */
-                    CLI->ESCPos=1;
-                    CLI->ESCStart=CLI_GET_MILLISEC_COUNTER();
-                break;
-                case '\r':
-                    /* We are done */
-                    CLI_PUTCHAR('\n');
-                    CLI_PUTCHAR('\r');
-
-                    /* Add to the end of the history buffer (if we have one,
-                       it's not a blank line, and the last key was not an
-                       arrow) */
-                    if(CLI->HistoryBuff!=NULL && *CLI->LineBuff!=0)
+                    else
                     {
-                        if(CLI->LastKeyType==e_CLILastKey_Other)
-                        {
-                            l=STRLEN(CLI->LineBuff)+1;  // We need space for the \0
-
-                            h=NULL;
-                            while(l<=CLI->HistoryBuffSize)
-                            {
-                                /* Search from the end of the buffer to the last
-                                   entry */
-                                for(h=CLI->HistoryBuff+CLI->HistoryBuffSize-1;
-                                        h>CLI->HistoryBuff;h--)
-                                {
-                                    if(*h!=0)
-                                    {
-                                        /* Move past the 0 */
-                                        h+=2;
-                                        break;
-                                    }
-                                }
-
-                                if(h>CLI->HistoryBuff+CLI->HistoryBuffSize-1)
-                                {
-                                    /* Error we are past the end of the buffer.
-                                       Likely means the buffer is overflowing */
-                                    h=CLI->HistoryBuff+CLI->HistoryBuffSize-1;
-                                }
-
-                                /* Ok, 'h' is at the insert point.  Make sure
-                                   there's space */
-                                p=CLI->HistoryBuff+CLI->HistoryBuffSize-h;
-                                if(l>p)
-                                {
-                                    /* No space we need to drop the oldest entry */
-                                    h=strchr(CLI->HistoryBuff,0)+1; // +1 for the \0
-
-                                    /* Hu? We didn't find a \0? */
-                                    if(h==NULL)
-                                        break;
-
-                                    /* Figure out how many bytes to copy (the
-                                       size-the STRLEN of the first entry) */
-                                    bytes=CLI->HistoryBuffSize-(h-CLI->HistoryBuff);
-                                    memcpy(CLI->HistoryBuff,h,bytes);
-
-                                    /* The number of bytes to clear at the end
-                                       of the buffer (STRLEN of first entry +
-                                       old padding space) */
-                                    bytes=h-CLI->HistoryBuff+p;
-                                    memset(CLI->HistoryBuff+
-                                            CLI->HistoryBuffSize-bytes,0,bytes);
-
-                                    /* If we have no room, just abort the loop */
-                                    if(bytes==0)
-                                        break;
-                                }
-                                else
-                                {
-                                    break;
-                                }
-                            }
-
-                            /* Copy in the new entry if we have space */
-                            if(h!=NULL &&
-                                    l<=CLI->HistoryBuff+CLI->HistoryBuffSize-h)
-                            {
-                                strcpy(h,CLI->LineBuff);
-                                CLI->HistoryPos=h+l-1;
-                            }
-                        }
-                        else
-                        {
-                            /* Move to the end of the current history buffer */
-                            if(*(CLI->HistoryPos+1)!=0)
-                                CLI->HistoryPos=strchr(CLI->HistoryPos+1,0);
-                        }
-                    }
-                    CLI->LastKeyType=e_CLILastKey_Other;
-                    return CLI->LineBuff;
-                break;
-                case '\b':
-                case 127:
-                    if(CLI->LineBuffInsertPos>0)
-                    {
-                        CLI->LineBuffInsertPos--;
-
-                        /* Copy the char above the current pos */
-                        l=STRLEN(CLI->LineBuff);
-                        for(p=CLI->LineBuffInsertPos;p<l;p++)
-                            CLI->LineBuff[p]=CLI->LineBuff[p+1];
-
-                        /* Move over the char we just deleted, then redraw
-                           the end of the line */
-                        CLI_PUTCHAR('\b');
-                        CLI_EchoEndOfPromptLine(CLI,l-1);
-                    }
-                    CLI->LastKeyType=e_CLILastKey_Other;
-                break;
-                default:
-                    l=STRLEN(CLI->LineBuff);
-                    if(l<CLI->MaxLineSize-1)
-                    {
-                        /* Make room */
-                        for(p=l;p>CLI->LineBuffInsertPos;p--)
-                            CLI->LineBuff[p+1]=CLI->LineBuff[p];
-                        CLI->LineBuff[CLI->LineBuffInsertPos+1]=
-                                CLI->LineBuff[CLI->LineBuffInsertPos];
-                        CLI->LineBuff[CLI->LineBuffInsertPos]=c;
-
-                        CLI_EchoEndOfPromptLine(CLI,l+1);
-
-                        CLI->LineBuffInsertPos++;
-
-                        /* Move one char over */
-                        if(CLI->PasswordMode)
-                            CLI_PUTCHAR('*');
-                        else
-                            CLI_PUTCHAR(c);
-                    }
-                    CLI->LastKeyType=e_CLILastKey_Other;
-                break;
-            }
-        }
+                        CLI_EchoEndOfPromptLine(CLI,l+1);
+                    }
+
+                    CLI->LineBuffInsertPos++;
+
+                    /* Move one char over */
+                    if(CLI->PasswordMode)
+                        CLI_PutChar(CLI,'*');
+                    else
+                        CLI_PutChar(CLI,c);
+                }
+            }
+            CLI->LastKeyType=e_CLILastKey_Other;
+        break;
     }
     return NULL;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HandleKey
+ *
+ * SYNOPSIS:
+ *    static void CLI_HandleKey(struct CLIHandlePrv *CLI,e_CLIKeyType Key);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Key [I] -- The key we got from the escape seq decoder
+ *
+ * FUNCTION:
+ *    This is helper function for the CLI_ProcessInputChar() function.  It
+ *    does the editing for keys that come in as escape seq's (arrows, home,
+ *    end, del, ...).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_ProcessInputChar(), CLI_ESC_Decode()
+ ******************************************************************************/
+static void CLI_HandleKey(struct CLIHandlePrv *CLI,e_CLIKeyType Key)
+{
+    unsigned int l;
+
+    switch(Key)
+    {
+        case e_CLIKey_Right:
+            if(CLI->LineBuffInsertPos<CLI->LineBuffLen)
+            {
+                CLI_MoveCaret(CLI,CLI->LineBuffInsertPos+1);
+            }
+        break;
+        case e_CLIKey_Left:
+            if(CLI->LineBuffInsertPos>0)
+            {
+                CLI_MoveCaret(CLI,CLI->LineBuffInsertPos-1);
+            }
+        break;
+        case e_CLIKey_End:
+            CLI_MoveCaret(CLI,CLI->LineBuffLen);
+        break;
+        case e_CLIKey_Del:
+            l=CLI->LineBuffLen;
+            if(CLI->LineBuffInsertPos<l)
+            {
+                /* Copy the chars above the current pos down (with the
+                   \0) */
+                memmove(&CLI->LineBuff[CLI->LineBuffInsertPos],
+                        &CLI->LineBuff[CLI->LineBuffInsertPos+1],
+                        l-CLI->LineBuffInsertPos);
+                CLI->LineBuffLen--;
+
+                if(CLI_NeedView(CLI,l))
+                {
+                    CLI_RedrawLineFrom(CLI,CLI->LineBuffInsertPos,
+                            CLI->LineBuffInsertPos,l);
+                }
+                else
+                {
+                    CLI_DeleteCharOnScreen(CLI);
+                }
+            }
+        break;
+        case e_CLIKey_Home:
+            CLI_MoveCaret(CLI,0);
+        break;
+        case e_CLIKey_Up:
+            if(CLI->HistoryBuff!=NULL)
+            {
+                /* Move to the prev entry in the history (we stay on the
+                   oldest one) */
+                if(CLI->HistoryIndex>0)
+                    CLI_HistoryPrev(CLI);
+                CLI_ShowHistoryEntry(CLI);
+            }
+            CLI->LastKeyType=e_CLILastKey_Up;
+        break;
+        case e_CLIKey_Down:
+            if(CLI->HistoryBuff!=NULL)
+            {
+                /* Move to the next entry in the history (past the newest
+                   one is a blank line) */
+                if(CLI->HistoryIndex<CLI->HistoryCount)
+                    CLI_HistoryNext(CLI);
+                CLI_ShowHistoryEntry(CLI);
+            }
+            CLI->LastKeyType=e_CLILastKey_Down;
+        break;
+        case e_CLIKey_Esc:
+            /* Clear the line */
+            CLI_EraseCurrentLine(CLI);
+            CLI_ResetInputBuffer(CLI);
+        break;
+        case e_CLIKey_PasteStart:
+            CLI->Pasting=true;
+        break;
+        case e_CLIKey_PasteEnd:
+            CLI->Pasting=false;
+        break;
+        case e_CLIKey_None:
+        case e_CLIKey_NotESC:
+        case e_CLIKey_Insert:
+        case e_CLIKey_PgUp:
+        case e_CLIKey_PgDown:
+        case e_CLIKeyMAX:
+        default:
+        break;
+    }
 }
 
 /*******************************************************************************
@@ -603,17 +1099,17 @@ static void CLI_EchoEndOfPromptLine(struct CLIHandlePrv *CLI,unsigned int len)
     for(p=CLI->LineBuffInsertPos;p<len;p++)
     {
         if(CLI->PasswordMode)
-            CLI_PUTCHAR('*');
+            CLI_PutChar(CLI,'*');
         else
-            CLI_PUTCHAR(CLI->LineBuff[p]);
+            CLI_PutChar(CLI,CLI->LineBuff[p]);
     }
 
     /* Add a space on the end to kill off any deleted chars */
-    CLI_PUTCHAR(' ');
+    CLI_PutChar(CLI,' ');
 
     /* Now back up to where we should be */
     for(p=CLI->LineBuffInsertPos;p<len+1;p++)
-        CLI_PUTCHAR('\b');
+        CLI_PutChar(CLI,'\b');
 }
 
 /*******************************************************************************
@@ -638,8 +1134,11 @@ static void CLI_EchoEndOfPromptLine(struct CLIHandlePrv *CLI,unsigned int len)
 static void CLI_ResetInputBuffer(struct CLIHandlePrv *CLI)
 {
     CLI->LineBuffInsertPos=0;
+    CLI->LineBuffLen=0;
     *CLI->LineBuff=0;
-    CLI->ESCPos=0;
+    CLI->ESC.State=e_CLIESC_Idle;
+    CLI->ViewStart=0;
+    CLI->ViewDrawn=0;
 }
 
 /*******************************************************************************
@@ -669,19 +1168,38 @@ static void CLI_EraseCurrentLine(struct CLIHandlePrv *CLI)
     unsigned int p;
     unsigned int len;
 
-    len=STRLEN(CLI->LineBuff);
+    len=CLI->LineBuffLen;
+
+    if(CLI_NeedView(CLI,len))
+    {
+        /* Only the window is on the screen */
+        CLI_CursorLeft(CLI,CLI->LineBuffInsertPos-CLI->ViewStart);
+        CLI->LineBuffInsertPos=0;
+        len=CLI->ViewDrawn;
+        CLI->ViewStart=0;
+        CLI->ViewDrawn=0;
+    }
+
+    if(CLI->ANSIMode)
+    {
+        CLI_CursorLeft(CLI,CLI->LineBuffInsertPos);
+        CLI->LineBuffInsertPos=0;
+        if(len>0)
+            CLI_SendCSI(CLI,1,'K');
+        return;
+    }
 
     /* Goto the start of the line */
     for(;CLI->LineBuffInsertPos>0;CLI->LineBuffInsertPos--)
-        CLI_PUTCHAR('\b');
+        CLI_PutChar(CLI,'\b');
 
     /* Space over the whole thing */
     for(p=0;p<len;p++)
-        CLI_PUTCHAR(' ');
+        CLI_PutChar(CLI,' ');
 
     /* Now back up to the start */
     for(p=0;p<len;p++)
-        CLI_PUTCHAR('\b');
+        CLI_PutChar(CLI,'\b');
 }
 
 /*******************************************************************************
@@ -741,7 +1259,7 @@ void CLI_SetLineBuffer(struct CLIHandle *Handle,char *LineBuff,int MaxSize)
  *    NONE
  *
  * SEE ALSO:
- *    
+ *    CLI_AddHistoryEntry()
  ******************************************************************************/
 void CLI_SetHistoryBuffer(struct CLIHandle *Handle,char *HistoryBuff,
         int MaxSize)
@@ -749,14 +1267,102 @@ void CLI_SetHistoryBuffer(struct CLIHandle *Handle,char *HistoryBuff,
     struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
 
     CLI->HistoryBuff=HistoryBuff;
-    CLI->HistoryPos=HistoryBuff;
     CLI->HistoryBuffSize=MaxSize;
-    if(HistoryBuff==NULL)
+    if(HistoryBuff==NULL || MaxSize<0)
         CLI->HistoryBuffSize=0;
 
     CLI_ResetHistory(CLI);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_AddHistoryEntry
+ *
+ * SYNOPSIS:
+ *    void CLI_AddHistoryEntry(struct CLIHandle *Handle,const char *Line);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Line [I] -- The line to add to the end of the history
+ *
+ * FUNCTION:
+ *    This function adds a line to the end of the history as if it had been
+ *    typed in.  It is used to load history that was saved with
+ *    CLI_HISTORY_SAVE() (oldest line first).  Lines added with this function
+ *    are not passed to CLI_HISTORY_SAVE().
+ *
+ *    This must be called after CLI_SetHistoryBuffer().
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SetHistoryBuffer()
+ ******************************************************************************/
+void CLI_AddHistoryEntry(struct CLIHandle *Handle,const char *Line)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+
+    if(CLI->HistoryBuff==NULL || *Line==0)
+        return;
+
+    CLI_AddToHistory(CLI,Line,STRLEN(Line));
 }
 
+#ifdef CLI_MALLOC
+/*******************************************************************************
+ * NAME:
+ *    CLI_AllocBuffers
+ *
+ * SYNOPSIS:
+ *    bool CLI_AllocBuffers(struct CLIHandle *Handle,unsigned int LineSize,
+ *          unsigned int HistorySize);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the prompt to set the buffers for
+ *    LineSize [I] -- The size of the line buffer
+ *    HistorySize [I] -- The size of the history buffer (0 for no history)
+ *
+ * FUNCTION:
+ *    This function allocates the line and history buffers for a prompt
+ *    with CLI_MALLOC() (as one block) and sets them like CLI_SetLineBuffer()
+ *    and CLI_SetHistoryBuffer() would.  This lets every prompt have its own
+ *    sizes.  The buffers are freed by CLI_FreeHandle() (or by calling this
+ *    again).
+ *
+ *    Call this after CLI_InitPrompt().
+ *
+ * RETURNS:
+ *    true -- Buffers allocated and set
+ *    false -- Out of memory (the old buffers are left in place)
+ *
+ * SEE ALSO:
+ *    CLI_SetLineBuffer(), CLI_SetHistoryBuffer(), CLI_FreeHandle()
+ ******************************************************************************/
+bool CLI_AllocBuffers(struct CLIHandle *Handle,unsigned int LineSize,
+        unsigned int HistorySize)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+    char *Buff;
+
+    Buff=CLI_MALLOC(LineSize+HistorySize);
+    if(Buff==NULL)
+        return false;
+
+    if(CLI->AllocBuff!=NULL)
+        CLI_FREE(CLI->AllocBuff);
+    CLI->AllocBuff=Buff;
+
+    CLI_SetLineBuffer(Handle,Buff,LineSize);
+    if(HistorySize>0)
+        CLI_SetHistoryBuffer(Handle,&Buff[LineSize],HistorySize);
+    else
+        CLI_SetHistoryBuffer(Handle,NULL,0);
+
+    return true;
+}
+#endif
+
 /*******************************************************************************
  * NAME:
  *    CLI_SetPasswordMode
@@ -782,6 +1388,80 @@ void CLI_SetPasswordMode(struct CLIHandle *Handle,bool OnOff)
     struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
 
     CLI->PasswordMode=OnOff;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SetANSIMode
+ *
+ * SYNOPSIS:
+ *    void CLI_SetANSIMode(struct CLIHandle *Handle,bool OnOff);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    OnOff [I] -- true = the terminal understands ANSI cursor commands,
+ *                 false = dumb terminal (the default)
+ *
+ * FUNCTION:
+ *    This function turns on/off ANSI mode.  In ANSI mode editing the line
+ *    uses cursor movement and insert / delete / erase commands and only
+ *    sends the part of the line that changed.  This cuts down the number of
+ *    bytes sent a lot on slow links.  With it off only back space is used.
+ *
+ *    Turning it on also asks the terminal to mark pastes (bracketed paste,
+ *    ESC[?2004h) so they are echoed in one go, turning it off (or
+ *    CLI_FreeHandle()) asks it to stop.  These are only sent when the mode
+ *    changes.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SetPasswordMode()
+ ******************************************************************************/
+void CLI_SetANSIMode(struct CLIHandle *Handle,bool OnOff)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+
+    if(OnOff!=CLI->ANSIMode)
+    {
+        /* Ask the terminal to mark pastes (ESC[200~ .. ESC[201~) or stop */
+        CLIPrintStr(CLI,OnOff?"\33[?2004h":"\33[?2004l");
+        CLI_FlushOutput(CLI);
+    }
+    CLI->ANSIMode=OnOff;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SetTermWidth
+ *
+ * SYNOPSIS:
+ *    void CLI_SetTermWidth(struct CLIHandle *Handle,unsigned int Width);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Width [I] -- The number of columns the terminal has (0 = don't know)
+ *
+ * FUNCTION:
+ *    This function tells the prompt how wide the terminal is.  If the line
+ *    gets wider than this it is scrolled side ways in place of wrapping, and
+ *    only the part that is on the screen is redrawn when it is edited.  The
+ *    prompt is taken to be STRLEN() chars wide.
+ *
+ *    The new width is used from the next edit on.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SetANSIMode()
+ ******************************************************************************/
+void CLI_SetTermWidth(struct CLIHandle *Handle,unsigned int Width)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+
+    CLI->TermWidth=Width;
 }
 
 /*******************************************************************************
@@ -805,157 +1485,2377 @@ void CLI_SetPasswordMode(struct CLIHandle *Handle,bool OnOff)
  ******************************************************************************/
 static void CLI_ResetHistory(struct CLIHandlePrv *CLI)
 {
-    if(CLI->HistoryBuff!=NULL)
-    {
-        memset(CLI->HistoryBuff,0,CLI->HistoryBuffSize);
-        CLI->HistoryPos=CLI->HistoryBuff;
-    }
-}
-
-/*******************************************************************************
- * NAME:
- *    CLI_SetPromptStr
- *
- * SYNOPSIS:
- *    void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt);
- *
- * PARAMETERS:
- *    Handle [I] -- The handle to the command prompt.
- *    Prompt [I] -- The new prompt to use
- *
- * FUNCTION:
- *    This function changes the command prompt string.
- *
- * RETURNS:
- *    NONE
- *
- * SEE ALSO:
- *    
- ******************************************************************************/
-void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt)
-{
-    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
-
-    CLI->Prompt=Prompt;
-}
-
-/*******************************************************************************
- * NAME:
- *    CLI_RunCmdPrompt
- *
- * SYNOPSIS:
- *    void CLI_RunCmdPrompt(struct CLIHandle *Handle);
- *
- * PARAMETERS:
- *    Handle [I] -- The handle to the prompt to work on
- *
- * FUNCTION:
- *    This function process keys from the user and figures out the command to
- *    run.  You must call this regularly for it to work.
- *
- *    This is non-blocking.
- *
- * RETURNS:
- *    NONE
- *
- * SEE ALSO:
- *    
- ******************************************************************************/
-void CLI_RunCmdPrompt(struct CLIHandle *Handle)
-{
-    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
-    char *Line; // The line we got from the input
-
-    Line=CLI_GetLine(Handle);
-    if(Line!=NULL)
-    {
-        if(!CLI_RunLine(Handle,Line))
-            CLIPrintStr("Command not found.\r\n\r\n");
-
-        /* We are done with the buffer, reset for the next input */
-        CLI_ResetInputBuffer(CLI);
-
-        CLI_DrawPrompt(Handle);
-    }
-}
+    CLI->HistoryHead=0;
+    CLI->HistoryTail=0;
+    CLI->HistoryUsed=0;
+    CLI->HistoryCount=0;
+    CLI->HistoryIndex=0;
+    CLI->HistoryPos=0;
+#ifdef CLI_HISTORY_DEDUP_SIZE
+    memset(CLI->HistoryDups,0x00,sizeof(CLI->HistoryDups));
+#endif
+}
 
 /*******************************************************************************
  * NAME:
- *    CLI_RunLine
+ *    CLI_AddToHistory
  *
  * SYNOPSIS:
- *    bool CLI_RunLine(struct CLIHandle *Handle,char *Line);
+ *    static bool CLI_AddToHistory(struct CLIHandlePrv *CLI,const char *Line,
+ *              unsigned int LineLen);
  *
  * PARAMETERS:
- *    Handle [I] -- The handle to the prompt to work on
- *    Line [I] -- The raw line to process.  This will be overwritten.
+ *    CLI [I] -- The private data from the command prompt.
+ *    Line [I] -- The line to add (\0 terminated)
+ *    LineLen [I] -- The number of chars in 'Line' (not counting the \0)
  *
  * FUNCTION:
- *    This function takes a raw line and runs it.
+ *    This function adds a line to the end of the history.  The
+ *    history is a ring buffer so the oldest entries are dropped (by moving
+ *    'HistoryHead') until the new entry fits.  The history position is
+ *    moved back to the end.  Lines that are bigger than the history buffer
+ *    are not added.
+ *
+ *    With CLI_HISTORY_DEDUP_SIZE a line that is the same as the last entry
+ *    isn't added and one that is the same as an older entry has the old
+ *    copy moved to the end.
  *
  * RETURNS:
- *    true -- Command was found.
- *    false -- The command is unknown.
+ *    true -- The line was stored at the end of the history
+ *    false -- The line was not stored (too big or the same as the last
+ *             entry)
  *
  * SEE ALSO:
- *    
+ *    CLI_HistoryPrev(), CLI_HistoryNext()
  ******************************************************************************/
-bool CLI_RunLine(struct CLIHandle *Handle,char *Line)
+static bool CLI_AddToHistory(struct CLIHandlePrv *CLI,const char *Line,
+        unsigned int LineLen)
 {
-    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
-    unsigned int cmd;    // The command index we are looking at
-    int len;    // The len of the current command we are looking at
+    unsigned int Len;
+    unsigned int Bytes;
+#ifdef CLI_HISTORY_DEDUP_SIZE
+    uint32_t Hash;
+    uint32_t DropHash;
+    unsigned int Pos;
+    unsigned int r;
+    bool Found;
+#endif
 
-    /* Empty lines do not make errors */
-    if(*Line==0)
-        return true;
-
-    /* We got a line, scan the commands */
-    for(cmd=0;cmd<g_CLICmdsCount;cmd++)
+    Len=LineLen+1;                  // We need space for the \0
+    if(Len<=CLI->HistoryBuffSize)
     {
-        len=STRLEN(g_CLICmds[cmd].Cmd);
-        if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
-                (Line[len]==0 || Line[len]==' '))
-        {
-            /* Found a command, run it */
-            CLI_RunCMD(CLI,Line,&g_CLICmds[cmd]);
-            break;
-        }
-    }
+#ifdef CLI_HISTORY_DEDUP_SIZE
+        Hash=CLI_HashHistoryLine(Line)%CLI_HISTORY_DEDUP_SIZE;
 
-    if(cmd==g_CLICmdsCount)
-        return false;
-    return true;
+        /* If no entry has this hash it can't be a dup (no need to look) */
+        if(CLI->HistoryDups[Hash]>0)
+        {
+            /* Nearly always the newest entry with this hash is the dup.  We
+               only have to look through the history if it isn't and there
+               are other entries with this hash. */
+            Pos=CLI->HistoryDupPos[Hash];
+            Found=CLI_HistoryEntryIs(CLI,Pos,Line,Len);
+            if(!Found && CLI->HistoryDups[Hash]>1)
+            {
+                Pos=CLI->HistoryHead;
+                for(r=0;r<CLI->HistoryCount && !Found;r++)
+                {
+                    Found=CLI_HistoryEntryIs(CLI,Pos,Line,Len);
+                    if(!Found)
+                    {
+                        while(CLI->HistoryBuff[Pos]!=0)
+                        {
+                            Pos++;
+                            if(Pos==CLI->HistoryBuffSize)
+                                Pos=0;
+                        }
+                        Pos++;
+                        if(Pos==CLI->HistoryBuffSize)
+                            Pos=0;
+                    }
+                }
+            }
+
+            if(Found)
+            {
+                /* The same as the last line (the normal case), leave it be */
+                r=Pos+Len;
+                if(r>=CLI->HistoryBuffSize)
+                    r-=CLI->HistoryBuffSize;
+                if(r==CLI->HistoryTail)
+                {
+                    CLI->HistoryIndex=CLI->HistoryCount;
+                    CLI->HistoryPos=CLI->HistoryTail;
+                    return false;
+                }
+
+                /* Take the old copy out so it moves to the end */
+                CLI_RemoveHistoryEntry(CLI,Pos,Len);
+                CLI->HistoryDups[Hash]--;
+            }
+        }
+#endif
+
+        /* Drop the oldest entries until there is space */
+        while(CLI->HistoryBuffSize-CLI->HistoryUsed<Len)
+        {
+#ifdef CLI_HISTORY_DEDUP_SIZE
+            DropHash=2166136261U;
+#endif
+            while(CLI->HistoryBuff[CLI->HistoryHead]!=0)
+            {
+#ifdef CLI_HISTORY_DEDUP_SIZE
+                DropHash^=(uint8_t)CLI->HistoryBuff[CLI->HistoryHead];
+                DropHash*=16777619U;
+#endif
+                CLI->HistoryHead++;
+                if(CLI->HistoryHead==CLI->HistoryBuffSize)
+                    CLI->HistoryHead=0;
+                CLI->HistoryUsed--;
+            }
+            /* And the \0 */
+            CLI->HistoryHead++;
+            if(CLI->HistoryHead==CLI->HistoryBuffSize)
+                CLI->HistoryHead=0;
+            CLI->HistoryUsed--;
+            CLI->HistoryCount--;
+#ifdef CLI_HISTORY_DEDUP_SIZE
+            CLI->HistoryDups[DropHash%CLI_HISTORY_DEDUP_SIZE]--;
+#endif
+        }
+
+        /* Copy in the new entry (wrapping around the end of the buffer) */
+        Bytes=CLI->HistoryBuffSize-CLI->HistoryTail;
+        if(Bytes>Len)
+            Bytes=Len;
+        memcpy(&CLI->HistoryBuff[CLI->HistoryTail],Line,Bytes);
+        memcpy(CLI->HistoryBuff,&Line[Bytes],Len-Bytes);
+#ifdef CLI_HISTORY_DEDUP_SIZE
+        CLI->HistoryDups[Hash]++;
+        CLI->HistoryDupPos[Hash]=CLI->HistoryTail;
+#endif
+        CLI->HistoryTail+=Len;
+        if(CLI->HistoryTail>=CLI->HistoryBuffSize)
+            CLI->HistoryTail-=CLI->HistoryBuffSize;
+        CLI->HistoryUsed+=Len;
+        CLI->HistoryCount++;
+    }
+
+    CLI->HistoryIndex=CLI->HistoryCount;
+    CLI->HistoryPos=CLI->HistoryTail;
+
+    return Len<=CLI->HistoryBuffSize;
+}
+
+#ifdef CLI_HISTORY_DEDUP_SIZE
+/*******************************************************************************
+ * NAME:
+ *    CLI_HashHistoryLine
+ *
+ * SYNOPSIS:
+ *    static uint32_t CLI_HashHistoryLine(const char *Line);
+ *
+ * PARAMETERS:
+ *    Line [I] -- The line to hash
+ *
+ * FUNCTION:
+ *    This function hashes a history line (FNV-1a).  This must match the
+ *    hash done on the entries that are dropped in CLI_AddToHistory().
+ *
+ * RETURNS:
+ *    The hash value
+ *
+ * SEE ALSO:
+ *    CLI_AddToHistory()
+ ******************************************************************************/
+static uint32_t CLI_HashHistoryLine(const char *Line)
+{
+    uint32_t Hash;
+
+    Hash=2166136261U;
+    while(*Line!=0)
+    {
+        Hash^=(uint8_t)*Line++;
+        Hash*=16777619U;
+    }
+    return Hash;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HistoryEntryIs
+ *
+ * SYNOPSIS:
+ *    static bool CLI_HistoryEntryIs(struct CLIHandlePrv *CLI,unsigned int Pos,
+ *              const char *Line,unsigned int Len);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Pos [I] -- The offset of the history entry to check
+ *    Line [I] -- The line to compare with
+ *    Len [I] -- The number of bytes in 'Line' (with the \0)
+ *
+ * FUNCTION:
+ *    This function checks if the history entry at 'Pos' is the same as
+ *    'Line'.  The entry can wrap around the end of the history buffer.
+ *
+ * RETURNS:
+ *    true -- They are the same
+ *    false -- They are different
+ *
+ * SEE ALSO:
+ *    CLI_AddToHistory()
+ ******************************************************************************/
+static bool CLI_HistoryEntryIs(struct CLIHandlePrv *CLI,unsigned int Pos,
+        const char *Line,unsigned int Len)
+{
+    unsigned int r;
+
+    for(r=0;r<Len;r++)
+    {
+        if(CLI->HistoryBuff[Pos]!=Line[r])
+            return false;
+        Pos++;
+        if(Pos==CLI->HistoryBuffSize)
+            Pos=0;
+    }
+    return true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RemoveHistoryEntry
+ *
+ * SYNOPSIS:
+ *    static void CLI_RemoveHistoryEntry(struct CLIHandlePrv *CLI,
+ *              unsigned int Pos,unsigned int Len);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Pos [I] -- The offset of the history entry to remove
+ *    Len [I] -- The number of bytes in the entry (with the \0)
+ *
+ * FUNCTION:
+ *    This function takes an entry out of the history.  The oldest entry is
+ *    just dropped, any other one has the newer entries moved down over it
+ *    (and 'HistoryDupPos' is fixed for the ones that moved).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_AddToHistory()
+ ******************************************************************************/
+static void CLI_RemoveHistoryEntry(struct CLIHandlePrv *CLI,unsigned int Pos,
+        unsigned int Len)
+{
+    unsigned int From;
+    unsigned int Start;
+    unsigned int Offset;
+    unsigned int Bytes;
+    unsigned int Chunk;
+    unsigned int r;
+
+    From=Pos+Len;
+    if(From>=CLI->HistoryBuffSize)
+        From-=CLI->HistoryBuffSize;
+
+    if(Pos==CLI->HistoryHead)
+    {
+        CLI->HistoryHead=From;
+    }
+    else
+    {
+        /* Entries after this one move down 'Len' bytes (offsets are worked
+           out from the head so we can tell which are after it) */
+        Start=Pos+CLI->HistoryBuffSize-CLI->HistoryHead;
+        if(Start>=CLI->HistoryBuffSize)
+            Start-=CLI->HistoryBuffSize;
+        for(r=0;r<CLI_HISTORY_DEDUP_SIZE;r++)
+        {
+            if(CLI->HistoryDups[r]==0)
+                continue;
+            Offset=CLI->HistoryDupPos[r]+CLI->HistoryBuffSize-
+                    CLI->HistoryHead;
+            if(Offset>=CLI->HistoryBuffSize)
+                Offset-=CLI->HistoryBuffSize;
+            if(Offset>Start)
+            {
+                if(CLI->HistoryDupPos[r]<Len)
+                    CLI->HistoryDupPos[r]+=CLI->HistoryBuffSize;
+                CLI->HistoryDupPos[r]-=Len;
+            }
+        }
+
+        /* Move them in pieces that don't wrap around the end of the
+           buffer */
+        Bytes=CLI->HistoryTail+CLI->HistoryBuffSize-From;
+        if(Bytes>=CLI->HistoryBuffSize)
+            Bytes-=CLI->HistoryBuffSize;
+        while(Bytes>0)
+        {
+            Chunk=Bytes;
+            if(Chunk>CLI->HistoryBuffSize-Pos)
+                Chunk=CLI->HistoryBuffSize-Pos;
+            if(Chunk>CLI->HistoryBuffSize-From)
+                Chunk=CLI->HistoryBuffSize-From;
+            memmove(&CLI->HistoryBuff[Pos],&CLI->HistoryBuff[From],Chunk);
+            Pos+=Chunk;
+            if(Pos==CLI->HistoryBuffSize)
+                Pos=0;
+            From+=Chunk;
+            if(From==CLI->HistoryBuffSize)
+                From=0;
+            Bytes-=Chunk;
+        }
+        CLI->HistoryTail=Pos;
+    }
+    CLI->HistoryUsed-=Len;
+    CLI->HistoryCount--;
+}
+#endif
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HistoryPrev
+ *
+ * SYNOPSIS:
+ *    static void CLI_HistoryPrev(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function moves the history position back one entry.  This must
+ *    not be called if 'HistoryIndex' is 0.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_HistoryNext(), CLI_CopyHistoryEntry()
+ ******************************************************************************/
+static void CLI_HistoryPrev(struct CLIHandlePrv *CLI)
+{
+    unsigned int Pos;
+    unsigned int Before;
+
+    /* Back up on to the \0 of the prev entry, then to its first char */
+    Pos=(CLI->HistoryPos==0?CLI->HistoryBuffSize:CLI->HistoryPos)-1;
+    while(Pos!=CLI->HistoryHead)
+    {
+        Before=(Pos==0?CLI->HistoryBuffSize:Pos)-1;
+        if(CLI->HistoryBuff[Before]==0)
+            break;
+        Pos=Before;
+    }
+    CLI->HistoryPos=Pos;
+    CLI->HistoryIndex--;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HistoryNext
+ *
+ * SYNOPSIS:
+ *    static void CLI_HistoryNext(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function moves the history position forward one entry.  This
+ *    must not be called if 'HistoryIndex' is 'HistoryCount'.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_HistoryPrev(), CLI_CopyHistoryEntry()
+ ******************************************************************************/
+static void CLI_HistoryNext(struct CLIHandlePrv *CLI)
+{
+    unsigned int Pos;
+
+    /* Skip this entry and it's \0 */
+    Pos=CLI->HistoryPos;
+    while(CLI->HistoryBuff[Pos]!=0)
+    {
+        Pos++;
+        if(Pos==CLI->HistoryBuffSize)
+            Pos=0;
+    }
+    Pos++;
+    if(Pos==CLI->HistoryBuffSize)
+        Pos=0;
+    CLI->HistoryPos=Pos;
+    CLI->HistoryIndex++;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_CopyHistoryEntry
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_CopyHistoryEntry(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function copies the history entry at the current history position
+ *    into the line buffer.  If we are past the newest entry the line buffer
+ *    is made blank.
+ *
+ * RETURNS:
+ *    The number of chars at the start of the line buffer that did not
+ *    change.
+ *
+ * SEE ALSO:
+ *    CLI_HistoryPrev(), CLI_HistoryNext()
+ ******************************************************************************/
+static unsigned int CLI_CopyHistoryEntry(struct CLIHandlePrv *CLI)
+{
+    unsigned int Pos;
+    unsigned int r;
+    unsigned int Same;
+
+    r=0;
+    Same=0;
+    if(CLI->HistoryIndex<CLI->HistoryCount)
+    {
+        Pos=CLI->HistoryPos;
+        while(CLI->HistoryBuff[Pos]!=0 && r+1<CLI->MaxLineSize)
+        {
+            if(Same==r && r<CLI->LineBuffLen &&
+                    CLI->LineBuff[r]==CLI->HistoryBuff[Pos])
+            {
+                Same++;
+            }
+            CLI->LineBuff[r++]=CLI->HistoryBuff[Pos++];
+            if(Pos==CLI->HistoryBuffSize)
+                Pos=0;
+        }
+    }
+    CLI->LineBuff[r]=0;
+    CLI->LineBuffLen=r;
+
+    return Same;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SendCSI
+ *
+ * SYNOPSIS:
+ *    static void CLI_SendCSI(struct CLIHandlePrv *CLI,unsigned int Count,
+ *              char Cmd);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Count [I] -- The number to send with the command (1 is not sent
+ *                 because it's the default)
+ *    Cmd [I] -- The command char ('D'=left, 'C'=right, 'K'=erase to the
+ *               end of the line, '@'=insert a char, 'P'=delete a char)
+ *
+ * FUNCTION:
+ *    This function sends an ANSI control sequence (ESC [ Count Cmd).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CursorLeft(), CLI_CursorRight()
+ ******************************************************************************/
+static void CLI_SendCSI(struct CLIHandlePrv *CLI,unsigned int Count,char Cmd)
+{
+    char Buff[11];
+    unsigned int r;
+
+    CLI_PutChar(CLI,27);
+    CLI_PutChar(CLI,'[');
+    if(Count!=1)
+    {
+        r=0;
+        do
+        {
+            Buff[r++]='0'+Count%10;
+            Count/=10;
+        } while(Count>0);
+        while(r>0)
+            CLI_PutChar(CLI,Buff[--r]);
+    }
+    CLI_PutChar(CLI,Cmd);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_CSISize
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_CSISize(unsigned int Count);
+ *
+ * PARAMETERS:
+ *    Count [I] -- The number that will be sent with the command
+ *
+ * FUNCTION:
+ *    This function works out how many bytes CLI_SendCSI() will send.
+ *
+ * RETURNS:
+ *    The number of bytes
+ *
+ * SEE ALSO:
+ *    CLI_SendCSI()
+ ******************************************************************************/
+static unsigned int CLI_CSISize(unsigned int Count)
+{
+    unsigned int Bytes;
+
+    Bytes=3;
+    if(Count!=1)
+    {
+        for(;Count>=10;Count/=10)
+            Bytes++;
+        Bytes++;
+    }
+    return Bytes;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_CursorLeft
+ *
+ * SYNOPSIS:
+ *    static void CLI_CursorLeft(struct CLIHandlePrv *CLI,unsigned int Count);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Count [I] -- The number of chars to move left
+ *
+ * FUNCTION:
+ *    This function moves the caret left.  In ANSI mode this uses which
+ *    ever is shorter, back spaces or a cursor left command.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CursorRight()
+ ******************************************************************************/
+static void CLI_CursorLeft(struct CLIHandlePrv *CLI,unsigned int Count)
+{
+    if(Count==0)
+        return;
+
+    if(CLI->ANSIMode && CLI_CSISize(Count)<Count)
+    {
+        CLI_SendCSI(CLI,Count,'D');
+        return;
+    }
+
+    for(;Count>0;Count--)
+        CLI_PutChar(CLI,'\b');
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_CursorRight
+ *
+ * SYNOPSIS:
+ *    static void CLI_CursorRight(struct CLIHandlePrv *CLI,unsigned int From,
+ *              unsigned int Count);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    From [I] -- The position in the line buffer the caret is at
+ *    Count [I] -- The number of chars to move right
+ *
+ * FUNCTION:
+ *    This function moves the caret right over chars that are already on
+ *    the screen.  This is done by sending the chars again or in ANSI mode
+ *    with a cursor right command if that is shorter.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CursorLeft()
+ ******************************************************************************/
+static void CLI_CursorRight(struct CLIHandlePrv *CLI,unsigned int From,
+        unsigned int Count)
+{
+    if(Count==0)
+        return;
+
+    if(CLI->ANSIMode && CLI_CSISize(Count)<Count)
+    {
+        CLI_SendCSI(CLI,Count,'C');
+        return;
+    }
+
+    CLI_EchoChars(CLI,From,From+Count);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_EchoChars
+ *
+ * SYNOPSIS:
+ *    static void CLI_EchoChars(struct CLIHandlePrv *CLI,unsigned int From,
+ *              unsigned int To);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    From [I] -- The first char in the line buffer to send
+ *    To [I] -- The char after the last one to send
+ *
+ * FUNCTION:
+ *    This function sends part of the line buffer ('*'s in password mode).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_RedrawLineFrom()
+ ******************************************************************************/
+static void CLI_EchoChars(struct CLIHandlePrv *CLI,unsigned int From,
+        unsigned int To)
+{
+    for(;From<To;From++)
+    {
+        if(CLI->PasswordMode)
+            CLI_PutChar(CLI,'*');
+        else
+            CLI_PutChar(CLI,CLI->LineBuff[From]);
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RedrawLineFrom
+ *
+ * SYNOPSIS:
+ *    static void CLI_RedrawLineFrom(struct CLIHandlePrv *CLI,
+ *              unsigned int Cursor,unsigned int Same,unsigned int OldLen);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Cursor [I] -- Where the caret is on the screen
+ *    Same [I] -- The number of chars at the start of the line that are the
+ *                same on the screen and in the line buffer
+ *    OldLen [I] -- The number of chars of the old line on the screen
+ *
+ * FUNCTION:
+ *    This function updates the screen from the old line to what is in the
+ *    line buffer.  Only the chars from 'Same' on are sent and then the
+ *    caret is moved to 'LineBuffInsertPos'.  If the line is wider than the
+ *    terminal only the part in the window is drawn (CLI_RedrawView()).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CursorLeft(), CLI_CursorRight()
+ ******************************************************************************/
+static void CLI_RedrawLineFrom(struct CLIHandlePrv *CLI,unsigned int Cursor,
+        unsigned int Same,unsigned int OldLen)
+{
+    unsigned int r;
+    unsigned int Width;
+
+    if(CLI_NeedView(CLI,OldLen))
+    {
+        Width=CLI_ViewWidth(CLI);
+        CLI_RedrawView(CLI,Cursor,Same,OldLen,Width);
+        return;
+    }
+
+    /* Get to the first char that changed */
+    if(Cursor>Same)
+        CLI_CursorLeft(CLI,Cursor-Same);
+    else
+        CLI_CursorRight(CLI,Cursor,Same-Cursor);
+
+    CLI_EchoChars(CLI,Same,CLI->LineBuffLen);
+
+    /* Clear off the end of the old line */
+    if(OldLen>CLI->LineBuffLen)
+    {
+        if(CLI->ANSIMode)
+        {
+            CLI_SendCSI(CLI,1,'K');
+        }
+        else
+        {
+            for(r=CLI->LineBuffLen;r<OldLen;r++)
+                CLI_PutChar(CLI,' ');
+            CLI_CursorLeft(CLI,OldLen-CLI->LineBuffLen);
+        }
+    }
+
+    CLI_CursorLeft(CLI,CLI->LineBuffLen-CLI->LineBuffInsertPos);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ViewWidth
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_ViewWidth(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function works out how many chars of the line buffer fit on the
+ *    screen after the prompt.  The last 2 columns are not used so the
+ *    terminal never wraps (the dumb terminal redraws send a space after the
+ *    end of the line).
+ *
+ * RETURNS:
+ *    The number of chars in the window or 0 if we don't know the terminal
+ *    width (or there is no room to scroll).
+ *
+ * SEE ALSO:
+ *    CLI_SetTermWidth(), CLI_NeedView()
+ ******************************************************************************/
+static unsigned int CLI_ViewWidth(struct CLIHandlePrv *CLI)
+{
+    unsigned int PromptLen;
+
+    if(CLI->TermWidth==0)
+        return 0;
+
+    PromptLen=STRLEN(CLI->Prompt);
+    if(CLI->TermWidth<PromptLen+CLI_MIN_VIEW_WIDTH+2)
+        return 0;
+
+    return CLI->TermWidth-PromptLen-2;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_NeedView
+ *
+ * SYNOPSIS:
+ *    static bool CLI_NeedView(struct CLIHandlePrv *CLI,unsigned int OldLen);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    OldLen [I] -- The length of the line before the change we are drawing
+ *
+ * FUNCTION:
+ *    This function checks if the line is (or was) too wide for the terminal
+ *    so the screen has to be updated with CLI_RedrawLineFrom() (which only
+ *    draws the part of the line in the window).
+ *
+ * RETURNS:
+ *    true -- The line is scrolled, use CLI_RedrawLineFrom()
+ *    false -- The whole line is on the screen
+ *
+ * SEE ALSO:
+ *    CLI_RedrawView()
+ ******************************************************************************/
+static bool CLI_NeedView(struct CLIHandlePrv *CLI,unsigned int OldLen)
+{
+    unsigned int Width;
+
+    Width=CLI_ViewWidth(CLI);
+    return Width>0 && (CLI->ViewStart>0 || CLI->LineBuffLen>Width ||
+            OldLen>Width);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RedrawView
+ *
+ * SYNOPSIS:
+ *    static void CLI_RedrawView(struct CLIHandlePrv *CLI,unsigned int Cursor,
+ *              unsigned int Same,unsigned int OldLen,unsigned int Width);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Cursor [I] -- Where the caret is on the screen (in the line buffer)
+ *    Same [I] -- The number of chars at the start of the line that are the
+ *                same on the screen and in the line buffer
+ *    OldLen [I] -- The length of the old line
+ *    Width [I] -- The number of chars in the window (CLI_ViewWidth())
+ *
+ * FUNCTION:
+ *    This function is CLI_RedrawLineFrom() for a line that is wider than
+ *    the terminal.  Only the part of the line from 'ViewStart' that fits on
+ *    the screen is drawn.  When the caret goes off the end of the window it
+ *    is moved half a window at a time (so we don't redraw it every char).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_RedrawLineFrom()
+ ******************************************************************************/
+static void CLI_RedrawView(struct CLIHandlePrv *CLI,unsigned int Cursor,
+        unsigned int Same,unsigned int OldLen,unsigned int Width)
+{
+    unsigned int Start;
+    unsigned int End;
+    unsigned int Drawn;
+    unsigned int Pos;
+    unsigned int r;
+
+    /* The number of chars on the screen (all the old line if it fit) */
+    Drawn=CLI->ViewDrawn;
+    if(CLI->ViewStart==0 && OldLen<=Width)
+        Drawn=OldLen;
+
+    /* Move the window to keep the caret in it */
+    Pos=CLI->LineBuffInsertPos;
+    Start=CLI->ViewStart;
+    if(CLI->LineBuffLen<=Width)
+        Start=0;
+    else if(Pos<Start)
+        Start=Pos>Width/2?Pos-Width/2:0;
+    else if(Pos>=Start+Width)
+        Start=Pos-Width/2;
+    if(CLI->LineBuffLen>Width && Start+Width>CLI->LineBuffLen+1)
+        Start=CLI->LineBuffLen+1-Width;
+
+    if(Start!=CLI->ViewStart)
+    {
+        /* Back to the start of the window and draw it all again */
+        CLI_CursorLeft(CLI,Cursor-CLI->ViewStart);
+        CLI->ViewStart=Start;
+        Cursor=Start;
+        Same=Start;
+    }
+
+    End=CLI->LineBuffLen;
+    if(End>Start+Width)
+        End=Start+Width;
+    if(Same<Start)
+        Same=Start;
+    if(Same>End)
+        Same=End;
+
+    if(Same==End && Drawn==End-Start)
+    {
+        /* Nothing changed on the screen, just move the caret */
+        if(Cursor>Pos)
+            CLI_CursorLeft(CLI,Cursor-Pos);
+        else
+            CLI_CursorRight(CLI,Cursor,Pos-Cursor);
+        return;
+    }
+
+    if(Cursor>Same)
+        CLI_CursorLeft(CLI,Cursor-Same);
+    else
+        CLI_CursorRight(CLI,Cursor,Same-Cursor);
+
+    CLI_EchoChars(CLI,Same,End);
+
+    /* Clear off what is left of the old window */
+    if(Drawn>End-Start)
+    {
+        if(CLI->ANSIMode)
+        {
+            CLI_SendCSI(CLI,1,'K');
+        }
+        else
+        {
+            for(r=End-Start;r<Drawn;r++)
+                CLI_PutChar(CLI,' ');
+            CLI_CursorLeft(CLI,Drawn-(End-Start));
+        }
+    }
+    CLI->ViewDrawn=End-Start;
+
+    CLI_CursorLeft(CLI,End-Pos);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_MoveCaret
+ *
+ * SYNOPSIS:
+ *    static void CLI_MoveCaret(struct CLIHandlePrv *CLI,unsigned int Pos);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Pos [I] -- The position in the line buffer to move to
+ *
+ * FUNCTION:
+ *    This function moves the caret (and 'LineBuffInsertPos') without
+ *    changing the line.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CursorLeft(), CLI_CursorRight()
+ ******************************************************************************/
+static void CLI_MoveCaret(struct CLIHandlePrv *CLI,unsigned int Pos)
+{
+    unsigned int Cursor;
+
+    Cursor=CLI->LineBuffInsertPos;
+    CLI->LineBuffInsertPos=Pos;
+
+    if(CLI_NeedView(CLI,CLI->LineBuffLen))
+    {
+        CLI_RedrawLineFrom(CLI,Cursor,CLI->LineBuffLen,CLI->LineBuffLen);
+        return;
+    }
+
+    if(Cursor>Pos)
+        CLI_CursorLeft(CLI,Cursor-Pos);
+    else
+        CLI_CursorRight(CLI,Cursor,Pos-Cursor);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_DeleteCharOnScreen
+ *
+ * SYNOPSIS:
+ *    static void CLI_DeleteCharOnScreen(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function removes the char under the caret from the screen after
+ *    it has been removed from the line buffer.  In ANSI mode the terminal
+ *    is told to delete the char, if not the end of the line is sent again.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_EchoEndOfPromptLine()
+ ******************************************************************************/
+static void CLI_DeleteCharOnScreen(struct CLIHandlePrv *CLI)
+{
+    if(!CLI->ANSIMode)
+    {
+        CLI_EchoEndOfPromptLine(CLI,CLI->LineBuffLen);
+        return;
+    }
+
+    if(CLI->LineBuffInsertPos>=CLI->LineBuffLen)
+    {
+        /* Last char, just space over it */
+        CLI_PutChar(CLI,' ');
+        CLI_PutChar(CLI,'\b');
+    }
+    else
+    {
+        CLI_SendCSI(CLI,1,'P');
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FlushBurst
+ *
+ * SYNOPSIS:
+ *    static void CLI_FlushBurst(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function echos the chars that where inserted while more input was
+ *    waiting (a paste).  They are all sent at once along with the end of
+ *    the line (or an insert command in ANSI mode) instead of redrawing the
+ *    end of the line for each char.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_GetLine()
+ ******************************************************************************/
+static void CLI_FlushBurst(struct CLIHandlePrv *CLI)
+{
+    unsigned int Tail;
+
+    if(CLI->BurstCount==0)
+        return;
+
+    if(CLI_NeedView(CLI,CLI->LineBuffLen-CLI->BurstCount))
+    {
+        CLI_RedrawLineFrom(CLI,CLI->BurstPos,CLI->BurstPos,
+                CLI->LineBuffLen-CLI->BurstCount);
+        CLI->BurstCount=0;
+        return;
+    }
+
+    Tail=CLI->LineBuffLen-CLI->LineBuffInsertPos;
+    if(CLI->ANSIMode && Tail>0)
+    {
+        /* Open up space for the new chars and send them */
+        CLI_SendCSI(CLI,CLI->BurstCount,'@');
+        CLI_EchoChars(CLI,CLI->BurstPos,CLI->LineBuffInsertPos);
+    }
+    else
+    {
+        CLI_EchoChars(CLI,CLI->BurstPos,CLI->LineBuffLen);
+        CLI_CursorLeft(CLI,Tail);
+    }
+    CLI->BurstCount=0;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RedrawPromptLine
+ *
+ * SYNOPSIS:
+ *    static void CLI_RedrawPromptLine(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function goes back to the start of the line and draws the prompt
+ *    and the line buffer again.  This is used at the end of a paste where
+ *    the prompt was held back and what was left of the paste has already
+ *    been echoed.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_RunCmdPrompt()
+ ******************************************************************************/
+static void CLI_RedrawPromptLine(struct CLIHandlePrv *CLI)
+{
+    CLI_PutChar(CLI,'\r');
+    CLI_DrawPrompt((struct CLIHandle *)CLI);
+    CLI->ViewStart=0;
+    CLI->ViewDrawn=0;
+    CLI_RedrawLineFrom(CLI,0,0,0);
+    CLI_FlushOutput(CLI);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ShowHistoryEntry
+ *
+ * SYNOPSIS:
+ *    static void CLI_ShowHistoryEntry(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function replaces the line buffer with the history entry at the
+ *    current history position and updates the screen.  The caret is left
+ *    at the end of the line.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_CopyHistoryEntry(), CLI_RedrawLineFrom()
+ ******************************************************************************/
+static void CLI_ShowHistoryEntry(struct CLIHandlePrv *CLI)
+{
+    unsigned int Cursor;
+    unsigned int OldLen;
+    unsigned int Same;
+
+    Cursor=CLI->LineBuffInsertPos;
+    OldLen=CLI->LineBuffLen;
+    if(!CLI->ANSIMode)
+    {
+        /* Start from a blank line */
+        CLI_EraseCurrentLine(CLI);
+        Cursor=0;
+        OldLen=0;
+    }
+
+    Same=CLI_CopyHistoryEntry(CLI);
+    if(Same>OldLen)
+        Same=OldLen;
+
+    CLI->LineBuffInsertPos=CLI->LineBuffLen;
+    CLI_RedrawLineFrom(CLI,Cursor,Same,OldLen);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_StartSearch
+ *
+ * SYNOPSIS:
+ *    static void CLI_StartSearch(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function starts a reverse incremental search of the history
+ *    (Ctrl-R).  The chars typed after this are the search string and the
+ *    newest entry that has them in it is shown.  The line buffer isn't
+ *    touched until the search ends so it can be put back if the search is
+ *    aborted.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_SearchInputChar(), CLI_EndSearch()
+ ******************************************************************************/
+static void CLI_StartSearch(struct CLIHandlePrv *CLI)
+{
+    CLI->Searching=true;
+    CLI->SearchFailed=false;
+    CLI->SearchLen=0;
+    CLI->SearchStr[0]=0;
+    CLI->SearchWidth=STRLEN(CLI->Prompt)+CLI->LineBuffLen;
+    if(CLI_NeedView(CLI,CLI->LineBuffLen))
+        CLI->SearchWidth=STRLEN(CLI->Prompt)+CLI->ViewDrawn;
+
+    /* Start from the newest entry */
+    CLI->HistoryIndex=CLI->HistoryCount;
+    CLI->HistoryPos=CLI->HistoryTail;
+
+    CLI_DrawSearch(CLI);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_EndSearch
+ *
+ * SYNOPSIS:
+ *    static void CLI_EndSearch(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function ends a history search.  The last match is copied in to
+ *    the line buffer and the prompt is drawn again with it so it can be
+ *    edited or run.  If there is no match the line we had before the
+ *    search is drawn again (with the caret where it was).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_StartSearch()
+ ******************************************************************************/
+static void CLI_EndSearch(struct CLIHandlePrv *CLI)
+{
+    unsigned int Pos;
+
+    CLI->Searching=false;
+    Pos=CLI->LineBuffInsertPos;
+
+    /* If we have an entry from the history treat it like we got to it with
+       the arrows (so it isn't added again) */
+    if(CLI->HistoryIndex<CLI->HistoryCount)
+    {
+        CLI_CopyHistoryEntry(CLI);
+        Pos=CLI->LineBuffLen;
+        CLI->LastKeyType=e_CLILastKey_Up;
+    }
+    CLI->LineBuffInsertPos=CLI->LineBuffLen;
+
+    CLI_PutChar(CLI,'\r');
+    CLIPrintStr(CLI,CLI->Prompt);
+    CLI->ViewStart=0;
+    CLI->ViewDrawn=0;
+    CLI_RedrawLineFrom(CLI,0,0,0);
+    CLI_ClearSearchLine(CLI,STRLEN(CLI->Prompt)+CLI->LineBuffLen-
+            CLI->ViewStart);
+    if(Pos!=CLI->LineBuffInsertPos)
+        CLI_MoveCaret(CLI,Pos);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SearchInputChar
+ *
+ * SYNOPSIS:
+ *    static bool CLI_SearchInputChar(struct CLIHandlePrv *CLI,
+ *              unsigned char c);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    c [I] -- The char that was input.
+ *
+ * FUNCTION:
+ *    This function handles a char while we are in a history search.  Plain
+ *    chars are added to the search string, back space removes one, Ctrl-R
+ *    finds the next older match, and Ctrl-G gives up (putting back the line
+ *    we had before the search).  Any other key ends the search (keeping
+ *    the match) and is then handled as normal.
+ *
+ * RETURNS:
+ *    true -- The char was used by the search
+ *    false -- The search is over, process the char as normal
+ *
+ * SEE ALSO:
+ *    CLI_StartSearch(), CLI_SearchHistory()
+ ******************************************************************************/
+static bool CLI_SearchInputChar(struct CLIHandlePrv *CLI,unsigned char c)
+{
+    switch(c)
+    {
+        case 18:    // Ctrl-R
+            CLI_SearchHistory(CLI,true);
+        break;
+        case 7:     // Ctrl-G
+            CLI->HistoryIndex=CLI->HistoryCount;
+            CLI->HistoryPos=CLI->HistoryTail;
+            CLI_EndSearch(CLI);
+            CLI->LastKeyType=e_CLILastKey_Other;
+        return true;
+        case '\b':
+        case 127:
+            /* What we have will still match the shorter string (unless
+               the search had failed) */
+            if(CLI->SearchLen>0)
+            {
+                CLI->SearchStr[--CLI->SearchLen]=0;
+                CLI_SearchHistory(CLI,false);
+            }
+        break;
+        default:
+            if(c<' ' || c==255)
+            {
+                CLI_EndSearch(CLI);
+                return false;
+            }
+            if(CLI->SearchLen+1<sizeof(CLI->SearchStr))
+            {
+                CLI->SearchStr[CLI->SearchLen++]=c;
+                CLI->SearchStr[CLI->SearchLen]=0;
+                CLI_SearchHistory(CLI,false);
+            }
+        break;
+    }
+    CLI_DrawSearch(CLI);
+    return true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SearchHistory
+ *
+ * SYNOPSIS:
+ *    static void CLI_SearchHistory(struct CLIHandlePrv *CLI,bool Older);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Older [I] -- true = skip the current match and look for an older one,
+ *                 false = keep the current match if it still has the
+ *                 search string in it.
+ *
+ * FUNCTION:
+ *    This function finds the next history entry with the search string in
+ *    it.  It starts from the current match and works back (so adding a
+ *    char to the search string doesn't start again from the newest entry).
+ *    If nothing is found we stay on the old match and 'SearchFailed' is
+ *    set.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_HistoryEntryHas()
+ ******************************************************************************/
+static void CLI_SearchHistory(struct CLIHandlePrv *CLI,bool Older)
+{
+    unsigned int SavedIndex;
+    unsigned int SavedPos;
+
+    if(!Older && CLI->HistoryIndex<CLI->HistoryCount &&
+            CLI_HistoryEntryHas(CLI,CLI->HistoryPos))
+    {
+        CLI->SearchFailed=false;
+        return;
+    }
+
+    SavedIndex=CLI->HistoryIndex;
+    SavedPos=CLI->HistoryPos;
+    do
+    {
+        if(CLI->HistoryIndex==0)
+        {
+            /* Nothing older, stay where we where */
+            CLI->HistoryIndex=SavedIndex;
+            CLI->HistoryPos=SavedPos;
+            CLI->SearchFailed=true;
+            return;
+        }
+        CLI_HistoryPrev(CLI);
+    } while(!CLI_HistoryEntryHas(CLI,CLI->HistoryPos));
+
+    CLI->SearchFailed=false;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_HistoryEntryHas
+ *
+ * SYNOPSIS:
+ *    static bool CLI_HistoryEntryHas(struct CLIHandlePrv *CLI,
+ *              unsigned int Pos);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Pos [I] -- The offset of the history entry to check
+ *
+ * FUNCTION:
+ *    This function checks if a history entry has the search string in it.
+ *    The entry can wrap around the end of the history buffer.
+ *
+ * RETURNS:
+ *    true -- The search string is in the entry
+ *    false -- It's not
+ *
+ * SEE ALSO:
+ *    CLI_SearchHistory()
+ ******************************************************************************/
+static bool CLI_HistoryEntryHas(struct CLIHandlePrv *CLI,unsigned int Pos)
+{
+    unsigned int p;
+    unsigned int r;
+
+    if(CLI->SearchLen==0)
+        return true;
+
+    for(;CLI->HistoryBuff[Pos]!=0;Pos=Pos+1<CLI->HistoryBuffSize?Pos+1:0)
+    {
+        p=Pos;
+        for(r=0;r<CLI->SearchLen && CLI->HistoryBuff[p]==CLI->SearchStr[r];r++)
+            p=p+1<CLI->HistoryBuffSize?p+1:0;
+        if(r==CLI->SearchLen)
+            return true;
+    }
+    return false;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_DrawSearch
+ *
+ * SYNOPSIS:
+ *    static void CLI_DrawSearch(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *
+ * FUNCTION:
+ *    This function draws the search line in place of the prompt:
+ *        (reverse-i-search)`string': match
+ *    The match is drawn right from the history (or the line buffer if
+ *    nothing has matched yet).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_ClearSearchLine()
+ ******************************************************************************/
+static void CLI_DrawSearch(struct CLIHandlePrv *CLI)
+{
+    const char *Label;
+    unsigned int Room;
+    unsigned int Width;
+    unsigned int Show;
+
+    Label=CLI->SearchFailed?"(failed reverse-i-search)`":"(reverse-i-search)`";
+
+    /* Only draw what fits on the terminal (if we know how wide it is) */
+    Room=~0U;
+    if(CLI->TermWidth>0)
+        Room=CLI->TermWidth-1;
+
+    CLI_PutChar(CLI,'\r');
+    Width=CLI_PrintClipped(CLI,Label,Room);
+    Width+=CLI_PrintClipped(CLI,CLI->SearchStr,Room-Width);
+    Width+=CLI_PrintClipped(CLI,"': ",Room-Width);
+
+    if(CLI->HistoryIndex<CLI->HistoryCount)
+    {
+        Show=CLI_PrintHistoryEntry(CLI,CLI->HistoryPos,Room-Width);
+    }
+    else
+    {
+        Show=CLI->LineBuffLen;
+        if(Show>Room-Width)
+            Show=Room-Width;
+        CLI_EchoChars(CLI,0,Show);
+    }
+
+    CLI_ClearSearchLine(CLI,Width+Show);
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_PrintClipped
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_PrintClipped(struct CLIHandlePrv *CLI,
+ *              const char *Str,unsigned int Room);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Str [I] -- The string to print
+ *    Room [I] -- The max number of chars to print
+ *
+ * FUNCTION:
+ *    This function prints a string, stopping after 'Room' chars.
+ *
+ * RETURNS:
+ *    The number of chars printed.
+ *
+ * SEE ALSO:
+ *    CLI_DrawSearch()
+ ******************************************************************************/
+static unsigned int CLI_PrintClipped(struct CLIHandlePrv *CLI,const char *Str,
+        unsigned int Room)
+{
+    unsigned int r;
+
+    for(r=0;r<Room && Str[r]!=0;r++)
+        CLI_PutChar(CLI,Str[r]);
+    return r;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_PrintHistoryEntry
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_PrintHistoryEntry(struct CLIHandlePrv *CLI,
+ *              unsigned int Pos,unsigned int Room);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Pos [I] -- The offset of the history entry to print
+ *    Room [I] -- The max number of chars to print
+ *
+ * FUNCTION:
+ *    This function prints a history entry, stopping after 'Room' chars (or
+ *    the size of the line buffer as that is all we can copy of it).  The
+ *    entry can wrap around the end of the history buffer.
+ *
+ * RETURNS:
+ *    The number of chars printed.
+ *
+ * SEE ALSO:
+ *    CLI_DrawSearch(), CLI_CopyHistoryEntry()
+ ******************************************************************************/
+static unsigned int CLI_PrintHistoryEntry(struct CLIHandlePrv *CLI,
+        unsigned int Pos,unsigned int Room)
+{
+    unsigned int r;
+
+    if(Room>CLI->MaxLineSize-1)
+        Room=CLI->MaxLineSize-1;
+
+    for(r=0;r<Room && CLI->HistoryBuff[Pos]!=0;r++)
+    {
+        CLI_PutChar(CLI,CLI->HistoryBuff[Pos++]);
+        if(Pos==CLI->HistoryBuffSize)
+            Pos=0;
+    }
+    return r;
+}
+
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ClearSearchLine
+ *
+ * SYNOPSIS:
+ *    static void CLI_ClearSearchLine(struct CLIHandlePrv *CLI,
+ *              unsigned int Width);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Width [I] -- The number of chars we just drew on the line
+ *
+ * FUNCTION:
+ *    This function clears off what is left of the last thing drawn by the
+ *    search (if it was longer) and remembers the new width.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_DrawSearch()
+ ******************************************************************************/
+static void CLI_ClearSearchLine(struct CLIHandlePrv *CLI,unsigned int Width)
+{
+    unsigned int r;
+
+    if(Width<CLI->SearchWidth)
+    {
+        if(CLI->ANSIMode)
+        {
+            CLI_SendCSI(CLI,1,'K');
+        }
+        else
+        {
+            for(r=Width;r<CLI->SearchWidth;r++)
+                CLI_PutChar(CLI,' ');
+            CLI_CursorLeft(CLI,CLI->SearchWidth-Width);
+        }
+    }
+    CLI->SearchWidth=Width;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SetPromptStr
+ *
+ * SYNOPSIS:
+ *    void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the command prompt.
+ *    Prompt [I] -- The new prompt to use
+ *
+ * FUNCTION:
+ *    This function changes the command prompt string.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    
+ ******************************************************************************/
+void CLI_SetPromptStr(struct CLIHandle *Handle,const char *Prompt)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+
+    CLI->Prompt=Prompt;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RunCmdPrompt
+ *
+ * SYNOPSIS:
+ *    void CLI_RunCmdPrompt(struct CLIHandle *Handle);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the prompt to work on
+ *
+ * FUNCTION:
+ *    This function process keys from the user and figures out the command to
+ *    run.  You must call this regularly for it to work.
+ *
+ *    Lines that come in a bracketed paste are run back to back and the
+ *    prompt is only drawn once when the paste is done.
+ *
+ *    This is non-blocking.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_WaitForInput(), CLI_GetNextWakeup()
+ ******************************************************************************/
+void CLI_RunCmdPrompt(struct CLIHandle *Handle)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+    char *Line; // The line we got from the input
+
+    Line=CLI_GetLine(Handle);
+    while(Line!=NULL)
+    {
+        if(!CLI_RunLine(Handle,Line))
+            CLIPrintStr(CLI,"Command not found.\r\n\r\n");
+
+        /* We are done with the buffer, reset for the next input */
+        CLI_ResetInputBuffer(CLI);
+
+        if(!CLI->Pasting)
+        {
+            CLI->PromptPending=false;
+            CLI_DrawPrompt(Handle);
+            break;
+        }
+
+        /* We are in the middle of a paste, run the next line right away
+           and hold off on the prompt until the paste is over */
+        CLI->PromptPending=true;
+        Line=CLI_GetLine(Handle);
+    }
+
+    if(CLI->PromptPending && !CLI->Pasting)
+    {
+        CLI->PromptPending=false;
+        CLI_RedrawPromptLine(CLI);
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_RunLine
+ *
+ * SYNOPSIS:
+ *    bool CLI_RunLine(struct CLIHandle *Handle,char *Line);
+ *
+ * PARAMETERS:
+ *    Handle [I] -- The handle to the prompt to work on
+ *    Line [I] -- The raw line to process.  This will be overwritten.
+ *
+ * FUNCTION:
+ *    This function takes a raw line and runs it.
+ *
+ * RETURNS:
+ *    true -- Command was found.
+ *    false -- The command is unknown.
+ *
+ * SEE ALSO:
+ *    
+ ******************************************************************************/
+bool CLI_RunLine(struct CLIHandle *Handle,char *Line)
+{
+    struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
+    const struct CLICommand *Cmd;   // The command the line is for
+
+    while(CLI_IsArgSpace(*Line))
+        Line++;
+
+    /* Empty lines do not make errors */
+    if(*Line==0)
+        return true;
+
+    /* We got a line, find the command */
+    Cmd=CLI_FindCmd(Line);
+    if(Cmd==NULL)
+        return false;
+
+    CLI_RunCMD(CLI,Line,Cmd);
+    return true;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FindCmd
+ *
+ * SYNOPSIS:
+ *    static const struct CLICommand *CLI_FindCmd(const char *Line);
+ *
+ * PARAMETERS:
+ *    Line [I] -- The line to find the command for.  The command is the
+ *                first word on the line.
+ *
+ * FUNCTION:
+ *    This function finds the command in g_CLICmds[] that a line starts
+ *    with.  If CLI_CMD_PERFECT_HASH is defined this uses the const tables
+ *    made by Tools/MakeCmdHash.py (if CLI_CheckCmdPHash() found they match
+ *    g_CLICmds[]).  If CLI_CMD_HASH_SIZE is defined this
+ *    uses the hash index (built by CLI_BuildCmdHash()).  If
+ *    CLI_CMD_TRIE_SIZE is defined this uses the trie (built by
+ *    CLI_BuildCmdTrie()) and the command can be any case and can be cut
+ *    short as long as it's only the start of one command.  If not it scans
+ *    g_CLICmds[].
+ *
+ * RETURNS:
+ *    The command or NULL if it was not found.
+ *
+ * SEE ALSO:
+ *    CLI_RunLine(), CLI_CheckCmdPHash(), CLI_BuildCmdHash(),
+ *    CLI_BuildCmdTrie()
+ ******************************************************************************/
+static const struct CLICommand *CLI_FindCmd(const char *Line)
+{
+    unsigned int cmd;   // The command index we are looking at
+    unsigned int len;   // The len of the current command we are looking at
+#if defined(CLI_CMD_HASH_SIZE) || defined(CLI_CMD_PERFECT_HASH)
+    uint32_t Hash;      // The hash of the command on the line
+    unsigned int Slot;  // The slot in the index we are looking at
+#endif
+#ifdef CLI_CMD_TRIE_SIZE
+    const struct CLICmdTrieNode *Node;  // The trie node for the command on the line
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+    if(m_CLI_CmdPHashOK && g_CLICmdsCount==CLI_CMDPHASH_COUNT)
+    {
+        /* Only one command can have this hash, see if it's the one */
+        Hash=CLI_HashCmd(Line,&len);
+        Slot=CLI_MixCmdHash(Hash^
+                g_CLICmdPHashDisp[Hash%CLI_CMDPHASH_BUCKETS])%
+                CLI_CMDPHASH_COUNT;
+        cmd=g_CLICmdPHashIndex[Slot];
+        if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
+                g_CLICmds[cmd].Cmd[len]==0)
+        {
+            return &g_CLICmds[cmd];
+        }
+        return NULL;
+    }
+#endif
+
+#ifdef CLI_CMD_HASH_SIZE
+    if(m_CLI_CmdHashOK && m_CLI_CmdHashCount==g_CLICmdsCount)
+    {
+        Hash=CLI_HashCmd(Line,&len);
+        Slot=Hash&(CLI_CMD_HASH_SIZE-1);
+        while(m_CLI_CmdHash[Slot]!=0)
+        {
+            if(m_CLI_CmdHashValue[Slot]==Hash)
+            {
+                cmd=m_CLI_CmdHash[Slot]-1;
+                if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
+                        g_CLICmds[cmd].Cmd[len]==0)
+                {
+                    return &g_CLICmds[cmd];
+                }
+            }
+            Slot=(Slot+1)&(CLI_CMD_HASH_SIZE-1);
+        }
+        return NULL;
+    }
+#endif
+
+#ifdef CLI_CMD_TRIE_SIZE
+    if(m_CLI_CmdTrieOK && m_CLI_CmdTrieCount==g_CLICmdsCount)
+    {
+        for(len=0;Line[len]!=0 && !CLI_IsArgSpace(Line[len]);len++)
+            ;
+        Node=CLI_FindCmdTrieNode(Line,len);
+
+        /* It has to be a whole name or the start of only one name */
+        if(len==0 || Node==NULL || (Node->Cmd==0 && Node->Count!=1))
+            return NULL;
+        return &g_CLICmds[CLI_GetCmdTrieCmd(Node,0)];
+    }
+#endif
+
+    for(cmd=0;cmd<g_CLICmdsCount;cmd++)
+    {
+        len=STRLEN(g_CLICmds[cmd].Cmd);
+        if(STRNCMP(Line,g_CLICmds[cmd].Cmd,len)==0 &&
+                (Line[len]==0 || CLI_IsArgSpace(Line[len])))
+        {
+            return &g_CLICmds[cmd];
+        }
+    }
+    return NULL;
+}
+
+#if defined(CLI_CMD_HASH_SIZE) || defined(CLI_CMD_PERFECT_HASH)
+/*******************************************************************************
+ * NAME:
+ *    CLI_HashCmd
+ *
+ * SYNOPSIS:
+ *    static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len);
+ *
+ * PARAMETERS:
+ *    Str [I] -- The string to hash.  This stops at a space / tab or the end
+ *               of the string.
+ *    Len [O] -- The number of chars that where hashed
+ *
+ * FUNCTION:
+ *    This function hashes a command name (FNV-1a).  A-Z are hashed as a-z
+ *    so this works if STRNCMP() ignores case or not.  This must match
+ *    HashCmd() in Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    The hash value
+ *
+ * SEE ALSO:
+ *    CLI_BuildCmdHash()
+ ******************************************************************************/
+static uint32_t CLI_HashCmd(const char *Str,unsigned int *Len)
+{
+    uint32_t Hash;
+    unsigned int r;
+    char c;
+
+    Hash=2166136261U;
+    for(r=0;Str[r]!=0 && !CLI_IsArgSpace(Str[r]);r++)
+    {
+        c=Str[r];
+        if(c>='A' && c<='Z')
+            c+='a'-'A';
+        Hash^=(uint8_t)c;
+        Hash*=16777619U;
+    }
+    *Len=r;
+    return Hash;
+}
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+/*******************************************************************************
+ * NAME:
+ *    CLI_MixCmdHash
+ *
+ * SYNOPSIS:
+ *    static uint32_t CLI_MixCmdHash(uint32_t Hash);
+ *
+ * PARAMETERS:
+ *    Hash [I] -- The command hash xor'ed with the displacement from
+ *                g_CLICmdPHashDisp[]
+ *
+ * FUNCTION:
+ *    This function mixes up the bits in a hash (the murmur3 finalizer) to
+ *    get the slot in g_CLICmdPHashIndex[].  This must match MixCmdHash() in
+ *    Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    The mixed hash value
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd(), CLI_HashCmd()
+ ******************************************************************************/
+static uint32_t CLI_MixCmdHash(uint32_t Hash)
+{
+    Hash^=Hash>>16;
+    Hash*=0x85EBCA6BU;
+    Hash^=Hash>>13;
+    Hash*=0xC2B2AE35U;
+    Hash^=Hash>>16;
+    return Hash;
+}
+#endif
+
+#ifdef CLI_CMD_PERFECT_HASH
+/*******************************************************************************
+ * NAME:
+ *    CLI_CheckCmdPHash
+ *
+ * SYNOPSIS:
+ *    static void CLI_CheckCmdPHash(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function checks that the perfect hash tables were made for the
+ *    g_CLICmds[] we have.  The names in g_CLICmds[] are hashed in order
+ *    and checked against CLI_CMDPHASH_NAMES_HASH from the .h.  If a
+ *    command was added, removed, renamed or moved and the .h wasn't made
+ *    again the tables are not used and we fall back to scanning
+ *    g_CLICmds[].  It is called from CLI_InitPrompt().
+ *
+ *    This must match NamesHash() in Tools/MakeCmdHash.py.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd()
+ ******************************************************************************/
+static void CLI_CheckCmdPHash(void)
+{
+    unsigned int cmd;
+    const char *Name;
+    uint32_t Hash;
+
+    /* FNV-1a of each name (with its \0) */
+    Hash=2166136261U;
+    for(cmd=0;cmd<g_CLICmdsCount;cmd++)
+    {
+        Name=g_CLICmds[cmd].Cmd;
+        do
+        {
+            Hash^=(uint8_t)*Name;
+            Hash*=16777619U;
+        } while(*Name++!=0);
+    }
+
+    CLI_LOCK();
+    m_CLI_CmdPHashOK=(g_CLICmdsCount==CLI_CMDPHASH_COUNT &&
+            Hash==CLI_CMDPHASH_NAMES_HASH);
+    CLI_UNLOCK();
+}
+#endif
+
+#ifdef CLI_CMD_HASH_SIZE
+/*******************************************************************************
+ * NAME:
+ *    CLI_BuildCmdHash
+ *
+ * SYNOPSIS:
+ *    static void CLI_BuildCmdHash(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function builds the hash index of g_CLICmds[] (open addressing,
+ *    linear probing).  It is called from CLI_InitPrompt() and only does the
+ *    work the first time (or if g_CLICmdsCount changed).
+ *
+ *    The index is not used (we fall back to scanning the commands) if
+ *    there are too many commands for CLI_CMD_HASH_SIZE or if a command name
+ *    has a space in it.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd()
+ ******************************************************************************/
+static void CLI_BuildCmdHash(void)
+{
+    unsigned int cmd;
+    unsigned int len;
+    uint32_t Hash;
+    unsigned int Slot;
+
+    CLI_LOCK();
+    if(m_CLI_CmdHashCount!=g_CLICmdsCount || !m_CLI_CmdHashOK)
+    {
+        memset(m_CLI_CmdHash,0,sizeof(m_CLI_CmdHash));
+
+        /* We need at least one empty slot to stop the search */
+        m_CLI_CmdHashOK=(g_CLICmdsCount<CLI_CMD_HASH_SIZE);
+        for(cmd=0;cmd<g_CLICmdsCount && m_CLI_CmdHashOK;cmd++)
+        {
+            Hash=CLI_HashCmd(g_CLICmds[cmd].Cmd,&len);
+            if(len==0 || g_CLICmds[cmd].Cmd[len]!=0)
+            {
+                m_CLI_CmdHashOK=false;
+                break;
+            }
+
+            /* Commands go in in order so the first one with a name is
+               found first (same as the scan) */
+            Slot=Hash&(CLI_CMD_HASH_SIZE-1);
+            while(m_CLI_CmdHash[Slot]!=0)
+                Slot=(Slot+1)&(CLI_CMD_HASH_SIZE-1);
+            m_CLI_CmdHash[Slot]=cmd+1;
+            m_CLI_CmdHashValue[Slot]=Hash;
+        }
+        m_CLI_CmdHashCount=g_CLICmdsCount;
+    }
+    CLI_UNLOCK();
+}
+#endif
+
+#ifdef CLI_CMD_TRIE_SIZE
+/*******************************************************************************
+ * NAME:
+ *    CLI_BuildCmdTrie
+ *
+ * SYNOPSIS:
+ *    static void CLI_BuildCmdTrie(void);
+ *
+ * PARAMETERS:
+ *    NONE
+ *
+ * FUNCTION:
+ *    This function builds the trie of the command names in g_CLICmds[].
+ *    Each node has a char (in lower case) with its children in a list.  The
+ *    node a name ends on has the command, and each node has the number of
+ *    commands under it (so we know if a short name is only the start of one
+ *    command).  It is called from CLI_InitPrompt() and only does the work
+ *    the first time (or if g_CLICmdsCount changed).
+ *
+ *    The trie is not used (we fall back to scanning the commands) if there
+ *    are too many nodes for CLI_CMD_TRIE_SIZE or if a command name is empty
+ *    or has a space in it.  A name that is the same as one before it
+ *    (ignoring case) can't be found.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_FindCmd(), CLI_FindCmdTrieNode()
+ ******************************************************************************/
+static void CLI_BuildCmdTrie(void)
+{
+    unsigned int cmd;
+    unsigned int Node;
+    unsigned int Child;
+    unsigned int Used;  // The number of nodes we have used
+    uint16_t *Link;
+    const char *Str;
+
+    CLI_LOCK();
+    if(m_CLI_CmdTrieCount!=g_CLICmdsCount || !m_CLI_CmdTrieOK)
+    {
+        /* Node 0 is the root (no chars) */
+        memset(&m_CLI_CmdTrie[0],0,sizeof(m_CLI_CmdTrie[0]));
+        Used=1;
+
+        m_CLI_CmdTrieOK=(g_CLICmdsCount<0xFFFF);
+        for(cmd=0;cmd<g_CLICmdsCount && m_CLI_CmdTrieOK;cmd++)
+        {
+            Str=g_CLICmds[cmd].Cmd;
+            Node=0;
+            for(;*Str!=0 && !CLI_IsArgSpace(*Str);Str++)
+            {
+                Child=CLI_CmdTrieChild(Node,*Str);
+                if(Child==0)
+                {
+                    if(Used>=CLI_CMD_TRIE_SIZE)
+                        break;
+
+                    /* New chars go on the end so the commands stay in the
+                       order they are in g_CLICmds[] */
+                    Child=Used++;
+                    memset(&m_CLI_CmdTrie[Child],0,sizeof(m_CLI_CmdTrie[0]));
+                    m_CLI_CmdTrie[Child].c=CLI_ToLower(*Str);
+                    Link=&m_CLI_CmdTrie[Node].Child;
+                    while(*Link!=0)
+                        Link=&m_CLI_CmdTrie[*Link].Next;
+                    *Link=Child;
+                }
+                Node=Child;
+            }
+            if(*Str!=0 || Node==0)
+            {
+                m_CLI_CmdTrieOK=false;
+                break;
+            }
+
+            if(m_CLI_CmdTrie[Node].Cmd==0)
+            {
+                m_CLI_CmdTrie[Node].Cmd=cmd+1;
+
+                /* Count it in all the nodes on the way to it */
+                Str=g_CLICmds[cmd].Cmd;
+                Node=0;
+                m_CLI_CmdTrie[0].Count++;
+                for(;*Str!=0;Str++)
+                {
+                    Node=CLI_CmdTrieChild(Node,*Str);
+                    m_CLI_CmdTrie[Node].Count++;
+                }
+            }
+        }
+        m_CLI_CmdTrieCount=g_CLICmdsCount;
+    }
+    CLI_UNLOCK();
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_CmdTrieChild
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_CmdTrieChild(unsigned int Node,char c);
+ *
+ * PARAMETERS:
+ *    Node [I] -- The index of the node in m_CLI_CmdTrie[] to look in
+ *    c [I] -- The char to look for (any case)
+ *
+ * FUNCTION:
+ *    This function finds the child of a trie node for a char.
+ *
+ * RETURNS:
+ *    The index of the child or 0 if there isn't one for 'c'.
+ *
+ * SEE ALSO:
+ *    CLI_BuildCmdTrie()
+ ******************************************************************************/
+static unsigned int CLI_CmdTrieChild(unsigned int Node,char c)
+{
+    unsigned int Child;
+
+    c=CLI_ToLower(c);
+    Child=m_CLI_CmdTrie[Node].Child;
+    while(Child!=0 && m_CLI_CmdTrie[Child].c!=c)
+        Child=m_CLI_CmdTrie[Child].Next;
+    return Child;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FindCmdTrieNode
+ *
+ * SYNOPSIS:
+ *    static const struct CLICmdTrieNode *CLI_FindCmdTrieNode(const char *Str,
+ *              unsigned int Len);
+ *
+ * PARAMETERS:
+ *    Str [I] -- The start of the command name to look for
+ *    Len [I] -- The number of chars in 'Str' to use
+ *
+ * FUNCTION:
+ *    This function follows the command trie down for the start of a
+ *    command name (ignoring case).
+ *
+ * RETURNS:
+ *    The node for the last char or NULL if no command starts with 'Str'.
+ *    The root is returned if 'Len' is 0.
+ *
+ * SEE ALSO:
+ *    CLI_GetCmdTrieCmd()
+ ******************************************************************************/
+static const struct CLICmdTrieNode *CLI_FindCmdTrieNode(const char *Str,
+        unsigned int Len)
+{
+    unsigned int Node;
+    unsigned int r;
+
+    Node=0;
+    for(r=0;r<Len;r++)
+    {
+        Node=CLI_CmdTrieChild(Node,Str[r]);
+        if(Node==0)
+            return NULL;
+    }
+    return &m_CLI_CmdTrie[Node];
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetCmdTrieCmd
+ *
+ * SYNOPSIS:
+ *    static unsigned int CLI_GetCmdTrieCmd(const struct CLICmdTrieNode *Node,
+ *              unsigned int Nth);
+ *
+ * PARAMETERS:
+ *    Node [I] -- The node to look under
+ *    Nth [I] -- Which of the commands under 'Node' to get.  This must be
+ *               less than 'Node->Count'.
+ *
+ * FUNCTION:
+ *    This function gets one of the commands that start with the chars up
+ *    to 'Node'.  The command that ends on 'Node' is first, then the ones
+ *    under each child in turn.  The counts tell us which child to go down
+ *    so this only looks at the nodes on the way to the command.
+ *
+ * RETURNS:
+ *    The index of the command in g_CLICmds[]
+ *
+ * SEE ALSO:
+ *    CLI_FindCmdTrieNode()
+ ******************************************************************************/
+static unsigned int CLI_GetCmdTrieCmd(const struct CLICmdTrieNode *Node,
+        unsigned int Nth)
+{
+    const struct CLICmdTrieNode *Child;
+
+    for(;;)
+    {
+        if(Node->Cmd!=0)
+        {
+            if(Nth==0)
+                return Node->Cmd-1;
+            Nth--;
+        }
+
+        Child=&m_CLI_CmdTrie[Node->Child];
+        while(Nth>=Child->Count)
+        {
+            Nth-=Child->Count;
+            Child=&m_CLI_CmdTrie[Child->Next];
+        }
+        Node=Child;
+    }
+}
+#endif
+
+/*******************************************************************************
+ * NAME:
+ *    CLIPrintStr
+ *
+ * SYNOPSIS:
+ *    static void CLIPrintStr(struct CLIHandlePrv *CLI,const char *Str);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.  This can be NULL
+ *               if we don't have a prompt.
+ *    Str [I] -- The string to print
+ *
+ * FUNCTION:
+ *    This function is a helper function that prints a string using the HAL.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_PutChar()
+ ******************************************************************************/
+static void CLIPrintStr(struct CLIHandlePrv *CLI,const char *Str)
+{
+    while(*Str!=0)
+    {
+        CLI_PutChar(CLI,*Str);
+        Str++;
+    }
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_PutChar
+ *
+ * SYNOPSIS:
+ *    static void CLI_PutChar(struct CLIHandlePrv *CLI,char c);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.  This can be NULL
+ *               if we don't have a prompt.
+ *    c [I] -- The char to output
+ *
+ * FUNCTION:
+ *    This function outputs a char.  If CLI_WRITE() is defined in the options
+ *    then the char is added to the prompts output buffer (which is sent
+ *    when it fills up or CLI_FlushOutput() is called), if not it is sent
+ *    right away with CLI_PUTCHAR().
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_FlushOutput(), CLIPrintStr()
+ ******************************************************************************/
+static void CLI_PutChar(struct CLIHandlePrv *CLI,char c)
+{
+#ifdef CLI_WRITE
+    if(CLI==NULL)
+    {
+        /* No prompt to buffer in, just send it */
+        CLI_WRITE(&c,1);
+        return;
+    }
+
+    if(CLI->WriteBuffLen>=sizeof(CLI->WriteBuff))
+        CLI_FlushOutput(CLI);
+
+    CLI->WriteBuff[CLI->WriteBuffLen++]=c;
+#else
+    (void)CLI;
+    CLI_PUTCHAR(c);
+#endif
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_FlushOutput
+ *
+ * SYNOPSIS:
+ *    static void CLI_FlushOutput(struct CLIHandlePrv *CLI);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.  This can be NULL
+ *               if we don't have a prompt.
+ *
+ * FUNCTION:
+ *    This function sends anything that is waiting in the output buffer
+ *    (with CLI_WRITE()).  It is called before we return to the main app
+ *    and before we run a command (so the commands output comes out in the
+ *    correct order).
+ *
+ *    This does nothing if CLI_WRITE() is not defined in the options.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_PutChar()
+ ******************************************************************************/
+static void CLI_FlushOutput(struct CLIHandlePrv *CLI)
+{
+#ifdef CLI_WRITE
+    if(CLI==NULL || CLI->WriteBuffLen==0)
+        return;
+
+    CLI_WRITE(CLI->WriteBuff,CLI->WriteBuffLen);
+    CLI->WriteBuffLen=0;
+#else
+    (void)CLI;
+#endif
+}
+
+#ifdef CLI_MALLOC
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetArgv
+ *
+ * SYNOPSIS:
+ *    static const char **CLI_GetArgv(struct CLIHandlePrv *CLI,
+ *          unsigned int *Size);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Size [I/O] -- The number of args we need room for.  This is changed
+ *                  to the number of args the argv has room for.
+ *
+ * FUNCTION:
+ *    This function gets the argv array for a command from the prompt's
+ *    arena.  The arena starts at CLI_MAX_ARGS pointers and is made bigger
+ *    (at least double) when a line has more args than fit, so most
+ *    commands don't allocate anything.
+ *
+ *    If the arena is in use (a command ran a line on it's own prompt) a
+ *    block just for this command is allocated.
+ *
+ *    Give the argv back with CLI_ReleaseArgv().
+ *
+ * RETURNS:
+ *    The argv array or NULL if we are out of memory.
+ *
+ * SEE ALSO:
+ *    CLI_ReleaseArgv(), CLI_RunCMD()
+ ******************************************************************************/
+static const char **CLI_GetArgv(struct CLIHandlePrv *CLI,unsigned int *Size)
+{
+    unsigned int NewSize;
+
+    if(CLI->ArgvInUse)
+        return CLI_MALLOC(*Size*sizeof(const char *));
+
+    if(*Size>CLI->ArgvSize)
+    {
+        NewSize=CLI->ArgvSize*2;
+        if(NewSize<CLI_MAX_ARGS)
+            NewSize=CLI_MAX_ARGS;
+        if(NewSize<*Size)
+            NewSize=*Size;
+
+        /* We don't need to keep the old args, so no realloc */
+        if(CLI->Argv!=NULL)
+            CLI_FREE((void *)CLI->Argv);
+        CLI->ArgvSize=0;
+        CLI->Argv=CLI_MALLOC(NewSize*sizeof(const char *));
+        if(CLI->Argv==NULL)
+            return NULL;
+        CLI->ArgvSize=NewSize;
+    }
+
+    *Size=CLI->ArgvSize;
+    CLI->ArgvInUse=true;
+    return CLI->Argv;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_ReleaseArgv
+ *
+ * SYNOPSIS:
+ *    static void CLI_ReleaseArgv(struct CLIHandlePrv *CLI,const char **Argv);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.
+ *    Argv [I] -- The argv from CLI_GetArgv()
+ *
+ * FUNCTION:
+ *    This function gives back an argv from CLI_GetArgv().
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_GetArgv()
+ ******************************************************************************/
+static void CLI_ReleaseArgv(struct CLIHandlePrv *CLI,const char **Argv)
+{
+    if(Argv==CLI->Argv)
+        CLI->ArgvInUse=false;
+    else
+        CLI_FREE((void *)Argv);
 }
-
-/*******************************************************************************
- * NAME:
- *    CLIPrintStr
- *
- * SYNOPSIS:
- *    static void CLIPrintStr(const char *Str);
- *
- * PARAMETERS:
- *    Str [I] -- The string to print
- *
- * FUNCTION:
- *    This function is a helper function that prints a string using the HAL.
- *
- * RETURNS:
- *    NONE
- *
- * SEE ALSO:
- *    
- ******************************************************************************/
-static void CLIPrintStr(const char *Str)
-{
-    while(*Str!=0)
-    {
-        CLI_PUTCHAR(*Str);
-        Str++;
-    }
-}
-
+#endif
+
 /*******************************************************************************
  * NAME:
  *    CLI_RunCMD
@@ -972,44 +3872,106 @@ static void CLIPrintStr(const char *Str)
  * FUNCTION:
  *    This function builds the args for the command and then run's it.
  *
+ *    The line is split with CLI_SplitArgs() (quotes, \ and runs of spaces)
+ *    and the args point into the line.  If CLI_MALLOC() is defined the line
+ *    is split right into the prompt's argv arena and if there are more args
+ *    than fit the arena is made bigger and filled in from the split line
+ *    (so there is no limit on the number of args).  If not the argv is on
+ *    the stack and lines with more than CLI_MAX_ARGS args are not run.
+ *
  * RETURNS:
  *    NONE
  *
  * SEE ALSO:
- *    
+ *    CLI_SplitArgs(), CLI_GetArgv()
  ******************************************************************************/
 static void CLI_RunCMD(struct CLIHandlePrv *CLI,char *Line,const struct CLICommand *Cmd)
 {
-    unsigned int r;         // Temp var (for loops)
-    unsigned int len;       // The len of the input line
-    uint16_t Argc;          // The number of args
-    char *Argv[CLI_MAX_ARGS];   // The argv's we are sending
+    unsigned int Argc;      // The number of args
+    const char **Argv;      // The argv's we are sending
+#ifdef CLI_MALLOC
+    unsigned int ArgvSize;  // The number of args that fit in 'Argv'
+#else
+    const char *ArgvBuff[CLI_MAX_ARGS]; // The storage for 'Argv'
+#endif
+    struct CLIHandlePrv *PrevActiveCLI; // The prompt that was running a command before us
+    const struct CLICommand *PrevRunningCmd; // The command this prompt was running before us
+#ifdef CLI_TYPED_ARGS
+    struct CLITypedArg PrevTypedArgs[CLI_TYPED_ARGS]; // The decoded args of 'PrevRunningCmd'
+    bool SaveTypedArgs;     // Do we have to put back 'PrevTypedArgs'
+#endif
 
-    len=STRLEN(Line);
+    if(Cmd->Exec==NULL)
+        return;
 
     /* Split up the command line */
-    Argc=0;
-    Argv[Argc++]=Line; // The name of the command
-    for(r=0;r<len;r++)
+#ifdef CLI_MALLOC
+    ArgvSize=CLI_MAX_ARGS;
+    Argv=CLI_GetArgv(CLI,&ArgvSize);
+    if(Argv!=NULL)
+    {
+        Argc=CLI_SplitArgs(Line,Argv,ArgvSize);
+        if(Argc>ArgvSize)
+        {
+            /* It didn't fit, get a bigger argv and fill it in again */
+            CLI_ReleaseArgv(CLI,Argv);
+            ArgvSize=Argc;
+            Argv=CLI_GetArgv(CLI,&ArgvSize);
+            if(Argv!=NULL)
+                CLI_FillArgv(Line,Argv,Argc);
+        }
+    }
+    if(Argv==NULL)
     {
-        if(Line[r]==' ')
-        {
-            Line[r]=0;
-            Argv[Argc++]=&Line[r+1];
-            if(Argc>CLI_MAX_ARGS)
-            {
-                CLIPrintStr("CLI_RunCMD:CLI_MAX_ARGS to small.\r\n");
-                return;
-            }
-        }
-    }
-
-    if(Cmd->Exec!=NULL)
+        CLIPrintStr(CLI,"CLI_RunCMD:Out of memory for args.\r\n");
+        CLI_FlushOutput(CLI);
+        return;
+    }
+#else
+    Argv=ArgvBuff;
+    Argc=CLI_SplitArgs(Line,Argv,CLI_MAX_ARGS);
+    if(Argc>CLI_MAX_ARGS)
     {
-        g_CLI_ActiveCLI=CLI;
-        g_CLI_ActiveCLI->RunningCmd=Cmd;
-        Cmd->Exec(Argc,(const char **)Argv);
-    }
+        CLIPrintStr(CLI,"CLI_RunCMD:CLI_MAX_ARGS to small.\r\n");
+        CLI_FlushOutput(CLI);
+        return;
+    }
+#endif
+
+    /* A command can run a line on another prompt (CLI_RunLine()) so
+       put back the old one when we are done.  It can also run a line on
+       this prompt so put back the command (and its decoded args) too */
+    PrevActiveCLI=g_CLI_ActiveCLI;
+    PrevRunningCmd=CLI->RunningCmd;
+#ifdef CLI_TYPED_ARGS
+    SaveTypedArgs=(PrevRunningCmd!=NULL && PrevRunningCmd->TypedArgs &&
+            Cmd->TypedArgs);
+    if(SaveTypedArgs)
+        memcpy(PrevTypedArgs,CLI->TypedArgs,sizeof(PrevTypedArgs));
+#endif
+    g_CLI_ActiveCLI=CLI;
+    g_CLI_ActiveCLI->RunningCmd=Cmd;
+
+    /* Send anything we have before the command starts outputting */
+    CLI_FlushOutput(CLI);
+
+#ifdef CLI_TYPED_ARGS
+    /* Commands with typed args only run if the args are good */
+    if(!Cmd->TypedArgs || CLI_DecodeArgs(CLI,(int)Argc,Argv))
+#endif
+        Cmd->Exec((int)Argc,Argv);
+
+    CLI_FlushOutput(CLI);
+#ifdef CLI_TYPED_ARGS
+    if(SaveTypedArgs)
+        memcpy(CLI->TypedArgs,PrevTypedArgs,sizeof(PrevTypedArgs));
+#endif
+    CLI->RunningCmd=PrevRunningCmd;
+    g_CLI_ActiveCLI=PrevActiveCLI;
+
+#ifdef CLI_MALLOC
+    CLI_ReleaseArgv(CLI,Argv);
+#endif
 }
 
 /*******************************************************************************
@@ -1049,15 +4011,16 @@ void CLI_DisplayHelp(void)
 
     for(cmd=0;cmd<g_CLICmdsCount;cmd++)
     {
-        CLIPrintStr(g_CLICmds[cmd].Cmd);
+        CLIPrintStr(g_CLI_ActiveCLI,g_CLICmds[cmd].Cmd);
 
         len=STRLEN(g_CLICmds[cmd].Cmd);
         for(;len<MaxWidth;len++)
-            CLI_PUTCHAR(' ');
+            CLI_PutChar(g_CLI_ActiveCLI,' ');
 
-        CLIPrintStr(g_CLICmds[cmd].Help);
-        CLIPrintStr("\r\n");
+        CLIPrintStr(g_CLI_ActiveCLI,g_CLICmds[cmd].Help);
+        CLIPrintStr(g_CLI_ActiveCLI,"\r\n");
     }
+    CLI_FlushOutput(g_CLI_ActiveCLI);
 }
 
 /*******************************************************************************
@@ -1084,7 +4047,8 @@ void CLI_DrawPrompt(struct CLIHandle *Handle)
 {
     struct CLIHandlePrv *CLI=(struct CLIHandlePrv *)Handle;
 
-    CLIPrintStr(CLI->Prompt);
+    CLIPrintStr(CLI,CLI->Prompt);
+    CLI_FlushOutput(CLI);
 }
 
 /*******************************************************************************
@@ -1145,21 +4109,21 @@ void CLI_OutputHelpDesc(unsigned int Indent,const char *Label,const char *Desc)
     const char *pos;
 
     for(r=0;r<HELP_INDENT*Indent;r++)
-        CLI_PUTCHAR(' ');
-    CLIPrintStr(Label);
-    CLIPrintStr(" -- ");
+        CLI_PutChar(g_CLI_ActiveCLI,' ');
+    CLIPrintStr(g_CLI_ActiveCLI,Label);
+    CLIPrintStr(g_CLI_ActiveCLI," -- ");
     pos=Desc;
     while(*pos!=0)
     {
         if(*pos=='\n')
-            CLI_PUTCHAR('\r');
-        CLI_PUTCHAR(*pos);
+            CLI_PutChar(g_CLI_ActiveCLI,'\r');
+        CLI_PutChar(g_CLI_ActiveCLI,*pos);
         if(*pos=='\n')
             for(r=0;r<HELP_INDENT*(Indent+2);r++)
-                CLI_PUTCHAR(' ');
+                CLI_PutChar(g_CLI_ActiveCLI,' ');
         pos++;
     }
-    CLIPrintStr("\r\n");
+    CLIPrintStr(g_CLI_ActiveCLI,"\r\n");
 }
 
 /*******************************************************************************
@@ -1307,13 +4271,19 @@ void CLI_CmdHelp_Arg(const char *Label,const char *Desc)
     switch(g_CLI_ActiveCLI->HelpState)
     {
         case e_CLI_HelpState_Usage:
-            CLIPrintStr(" [");
-            CLIPrintStr(Label);
-            CLIPrintStr("]");
+            CLIPrintStr(g_CLI_ActiveCLI," [");
+            CLIPrintStr(g_CLI_ActiveCLI,Label);
+            CLIPrintStr(g_CLI_ActiveCLI,"]");
         break;
         case e_CLI_HelpState_Details:
             CLI_OutputHelpDesc(1,Label,Desc);
         break;
+        case e_CLI_HelpState_Decode:
+#ifdef CLI_TYPED_ARGS
+            g_CLI_ActiveCLI->DecodeSubArg=0;
+            CLI_SetDecodeArg(g_CLI_ActiveCLI->ArgsOutput,Label);
+#endif
+        break;
         case e_CLI_HelpStateMAX:
         default:
         break;
@@ -1408,6 +4378,19 @@ void CLI_CmdHelp_SubArg(const char *Label,const char *Desc)
         case e_CLI_HelpState_Details:
             CLI_OutputHelpDesc(g_CLI_ActiveCLI->ArgsOutput+1,Label,Desc);
         break;
+        case e_CLI_HelpState_Decode:
+#ifdef CLI_TYPED_ARGS
+            /* Sub args are only for the option that matched */
+            if(g_CLI_ActiveCLI->DecodeSubArg!=0)
+            {
+                CLI_SetDecodeArg(g_CLI_ActiveCLI->DecodeSubArg++,Label);
+            }
+            else
+            {
+                CLI_SetDecodeArg(0,Label);
+            }
+#endif
+        break;
         default:
         break;
     }
@@ -1507,6 +4490,11 @@ void CLI_CmdHelp_OptionString(int Level,const char *Option,const char *Desc)
             }
             CLI_OutputHelpDesc(Level+2,Option,Desc);
         break;
+        case e_CLI_HelpState_Decode:
+#ifdef CLI_TYPED_ARGS
+            CLI_DecodeOption(Level,Option);
+#endif
+        break;
         case e_CLI_HelpStateMAX:
         default:
         break;
@@ -1559,17 +4547,89 @@ void CLI_CmdHelp_DotDotDot(void)
     switch(g_CLI_ActiveCLI->HelpState)
     {
         case e_CLI_HelpState_Usage:
-            CLIPrintStr(" ...");
+            CLIPrintStr(g_CLI_ActiveCLI," ...");
         break;
         case e_CLI_HelpState_Details:
             /* We only output the ... on the usage line */
         break;
+        case e_CLI_HelpState_Decode:
         case e_CLI_HelpStateMAX:
         default:
         break;
     }
 }
 
+/*******************************************************************************
+ * NAME:
+ *    CLI_CmdHelp_ArgType
+ *
+ * SYNOPSIS:
+ *    void CLI_CmdHelp_ArgType(e_CLIArgType Type);
+ *
+ * PARAMETERS:
+ *    Type [I] -- What the user can input for the arg:
+ *                  e_CLIArg_String -- Anything (the default)
+ *                  e_CLIArg_Int -- A decimal number (-2147483648 to
+ *                                  2147483647)
+ *                  e_CLIArg_Hex -- A hex number (0 to 0xFFFFFFFF, the 0x
+ *                                  is optional)
+ *                  e_CLIArg_Option -- One of the CLI_CmdHelp_OptionString()'s
+ *                                     for the arg
+ *
+ * FUNCTION:
+ *    This function sets the type of the last arg from CLI_CmdHelp_Arg() or
+ *    CLI_CmdHelp_SubArg().  It is only used if CLI_TYPED_ARGS is defined and
+ *    the command has 'TypedArgs' set in g_CLICmds[].  The prompt then checks
+ *    the args before running the command (a bad arg prints an error and the
+ *    command isn't run) and the command gets the values with
+ *    CLI_GetArgValue().
+ *
+ *    Only the args that are there are checked, the command still has to
+ *    check 'argc'.  A number arg can also have options (like "all"), an
+ *    arg that matches one of them isn't decoded as a number (see
+ *    CLI_GetOptionIndex()).
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * EXAMPLE:
+ *    CLI_CmdHelp_Start();
+ *
+ *    CLI_CmdHelp_Arg("Disk","What disk to work on");
+ *    CLI_CmdHelp_ArgType(e_CLIArg_Option);
+ *    CLI_CmdHelp_OptionString(0,"df0","Floppy disk 1");
+ *    CLI_CmdHelp_OptionString(0,"dh0","Hard drive 1");
+ *
+ *    CLI_CmdHelp_Arg("Offset","The offset to read from");
+ *    CLI_CmdHelp_ArgType(e_CLIArg_Hex);
+ *
+ *    CLI_CmdHelp_End();
+ *
+ *    "Read dh0 1F0" runs the command with CLI_GetArgValue(1)==1 and
+ *    CLI_GetArgValue(2)==0x1F0.  "Read hd0 1F0" and "Read dh0 1G0" print
+ *    an error.
+ *
+ * SEE ALSO:
+ *    CLI_GetArgValue(), CLI_CmdHelp_Arg(), CLI_CmdHelp_SubArg()
+ ******************************************************************************/
+void CLI_CmdHelp_ArgType(e_CLIArgType Type)
+{
+#ifdef CLI_TYPED_ARGS
+    unsigned int ArgNum;
+
+    if(g_CLI_ActiveCLI->HelpState!=e_CLI_HelpState_Decode)
+        return;
+
+    ArgNum=g_CLI_ActiveCLI->DecodeArg;
+    if(ArgNum==0 || ArgNum>CLI_TYPED_ARGS)
+        return;
+
+    g_CLI_ActiveCLI->TypedArgs[ArgNum-1].Type=Type;
+#else
+    (void)Type;
+#endif
+}
+
 /*******************************************************************************
  * NAME:
  *    CLI_CmdHelp_End
@@ -1595,11 +4655,12 @@ void CLI_CmdHelp_End(void)
     switch(g_CLI_ActiveCLI->HelpState)
     {
         case e_CLI_HelpState_Usage:
-            CLIPrintStr("\r\n");
+            CLIPrintStr(g_CLI_ActiveCLI,"\r\n");
         break;
         case e_CLI_HelpState_Details:
             /* Nothing to do here */
         break;
+        case e_CLI_HelpState_Decode:
         case e_CLI_HelpStateMAX:
         default:
         break;
@@ -1641,19 +4702,373 @@ void CLI_ShowCmdHelp(void)
     g_CLI_ActiveCLI->HelpState=e_CLI_HelpState_Usage;
 
     /* Output the usage banner */
-    CLIPrintStr("USAGE:\r\n");
+    CLIPrintStr(g_CLI_ActiveCLI,"USAGE:\r\n");
     for(r=0;r<HELP_INDENT;r++)
-        CLI_PUTCHAR(' ');
-    CLIPrintStr(g_CLI_ActiveCLI->RunningCmd->Cmd);
+        CLI_PutChar(g_CLI_ActiveCLI,' ');
+    CLIPrintStr(g_CLI_ActiveCLI,g_CLI_ActiveCLI->RunningCmd->Cmd);
     /* Call command to have it output the usage banner */
     g_CLI_ActiveCLI->RunningCmd->Exec(0,NULL);
 
     /* Output the details */
     g_CLI_ActiveCLI->HelpState=e_CLI_HelpState_Details;
-    CLIPrintStr("\r\nWHERE:\r\n");
+    CLIPrintStr(g_CLI_ActiveCLI,"\r\nWHERE:\r\n");
     /* Call command again to have it output the details */
     g_CLI_ActiveCLI->RunningCmd->Exec(0,NULL);
+
+    CLI_FlushOutput(g_CLI_ActiveCLI);
+}
+
+#ifdef CLI_TYPED_ARGS
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetArgValue
+ *
+ * SYNOPSIS:
+ *    int32_t CLI_GetArgValue(int Arg);
+ *
+ * PARAMETERS:
+ *    Arg [I] -- The argv index to get the value of (1 for the first arg)
+ *
+ * FUNCTION:
+ *    This function gets the value of an arg that the prompt decoded before
+ *    running the command.  This only works for commands that have
+ *    'TypedArgs' set in g_CLICmds[].
+ *
+ * RETURNS:
+ *    The value of the arg (the index of the option if it matched one):
+ *      e_CLIArg_Int -- The number
+ *      e_CLIArg_Hex -- The number (cast it to uint32_t)
+ *      e_CLIArg_Option -- The index of the option that matched (0 for the
+ *                         first CLI_CmdHelp_OptionString() for the arg)
+ *      e_CLIArg_String -- The index of the option that matched or -1 if
+ *                         none did
+ *    -1 if the arg wasn't decoded (the command doesn't have 'TypedArgs'
+ *    set, it's past CLI_TYPED_ARGS, it wasn't in the help block, or the
+ *    user didn't input it).
+ *
+ * SEE ALSO:
+ *    CLI_CmdHelp_ArgType(), CLI_GetOptionIndex()
+ ******************************************************************************/
+int32_t CLI_GetArgValue(int Arg)
+{
+    if(g_CLI_ActiveCLI==NULL || g_CLI_ActiveCLI->RunningCmd==NULL ||
+            !g_CLI_ActiveCLI->RunningCmd->TypedArgs || Arg<1 ||
+            Arg>CLI_TYPED_ARGS)
+    {
+        return -1;
+    }
+    return g_CLI_ActiveCLI->TypedArgs[Arg-1].Value;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_GetOptionIndex
+ *
+ * SYNOPSIS:
+ *    int CLI_GetOptionIndex(int Arg);
+ *
+ * PARAMETERS:
+ *    Arg [I] -- The argv index to get the option of (1 for the first arg)
+ *
+ * FUNCTION:
+ *    This function gets which of the CLI_CmdHelp_OptionString()'s for an
+ *    arg the user input.  The options are matched while the prompt decodes
+ *    the args so the command doesn't have to compare the arg with each
+ *    option it's self.  This only works for commands that have 'TypedArgs'
+ *    set in g_CLICmds[], but the arg can be any type (a e_CLIArg_Int arg
+ *    can have options like "all" as well as numbers).
+ *
+ * RETURNS:
+ *    The index of the option that matched (0 for the first
+ *    CLI_CmdHelp_OptionString() for the arg) or -1 if none did (or the arg
+ *    wasn't decoded, see CLI_GetArgValue()).
+ *
+ * EXAMPLE:
+ *    switch(CLI_GetOptionIndex(1))
+ *    {
+ *        case 0: // "on"
+ *        break;
+ *        case 1: // "off"
+ *        break;
+ *        default: // A number
+ *            Level=CLI_GetArgValue(1);
+ *        break;
+ *    }
+ *
+ * SEE ALSO:
+ *    CLI_GetArgValue(), CLI_CmdHelp_OptionString()
+ ******************************************************************************/
+int CLI_GetOptionIndex(int Arg)
+{
+    if(g_CLI_ActiveCLI==NULL || g_CLI_ActiveCLI->RunningCmd==NULL ||
+            !g_CLI_ActiveCLI->RunningCmd->TypedArgs || Arg<1 ||
+            Arg>CLI_TYPED_ARGS ||
+            g_CLI_ActiveCLI->TypedArgs[Arg-1].Option==CLI_NO_OPTION)
+    {
+        return -1;
+    }
+    return g_CLI_ActiveCLI->TypedArgs[Arg-1].Option;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_DecodeArgs
+ *
+ * SYNOPSIS:
+ *    static bool CLI_DecodeArgs(struct CLIHandlePrv *CLI,int Argc,
+ *          const char **Argv);
+ *
+ * PARAMETERS:
+ *    CLI [I] -- The private data from the command prompt.  This must be
+ *               'g_CLI_ActiveCLI' with 'RunningCmd' set.
+ *    Argc [I] -- The number of args the command is going to get
+ *    Argv [I] -- The args the command is going to get
+ *
+ * FUNCTION:
+ *    This function runs the command's help block to decode the args (like
+ *    CLI_ShowCmdHelp() does to output the help).  CLI_CmdHelp_ArgType()
+ *    sets the types and CLI_CmdHelp_OptionString() matches the options as
+ *    they go by, then the numbers are decoded.  If an arg is bad an error
+ *    is output.
+ *
+ * RETURNS:
+ *    true -- The args are good, run the command
+ *    false -- An arg was bad
+ *
+ * SEE ALSO:
+ *    CLI_GetArgValue(), CLI_RunCMD()
+ ******************************************************************************/
+static bool CLI_DecodeArgs(struct CLIHandlePrv *CLI,int Argc,const char **Argv)
+{
+    unsigned int r;
+    unsigned int BadArg;    // The first argv index that didn't decode (0=none)
+    struct CLITypedArg *Arg;
+
+    for(r=0;r<CLI_TYPED_ARGS;r++)
+    {
+        CLI->TypedArgs[r].Label=NULL;
+        CLI->TypedArgs[r].Value=-1;
+        CLI->TypedArgs[r].Type=e_CLIArg_String;
+        CLI->TypedArgs[r].OptionCount=0;
+        CLI->TypedArgs[r].Option=CLI_NO_OPTION;
+    }
+    CLI->DecodeArgc=Argc;
+    CLI->DecodeArgv=Argv;
+    CLI->DecodeArg=0;
+    CLI->DecodeSubArg=0;
+
+    CLI->HelpState=e_CLI_HelpState_Decode;
+    CLI->RunningCmd->Exec(0,NULL);
+
+    /* An arg that matched an option gets the option's index, otherwise
+       numbers have to decode and options are bad */
+    BadArg=0;
+    for(r=1;r<=CLI_TYPED_ARGS && (int)r<Argc && BadArg==0;r++)
+    {
+        Arg=&CLI->TypedArgs[r-1];
+        if(Arg->Option!=CLI_NO_OPTION)
+        {
+            Arg->Value=Arg->Option;
+        }
+        else if(Arg->Type==e_CLIArg_Int || Arg->Type==e_CLIArg_Hex)
+        {
+            if(!CLI_DecodeNumber(Argv[r],Arg->Type==e_CLIArg_Hex,
+                    &Arg->Value))
+            {
+                BadArg=r;
+            }
+        }
+        else if(Arg->Type==e_CLIArg_Option)
+        {
+            BadArg=r;
+        }
+    }
+
+    if(BadArg==0)
+        return true;
+
+    Arg=&CLI->TypedArgs[BadArg-1];
+    CLIPrintStr(CLI,"Invalid ");
+    CLIPrintStr(CLI,Arg->Label!=NULL?Arg->Label:"arg");
+    CLIPrintStr(CLI,": ");
+    CLIPrintStr(CLI,Argv[BadArg]);
+    CLIPrintStr(CLI,"\r\n");
+    return false;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_SetDecodeArg
+ *
+ * SYNOPSIS:
+ *    static void CLI_SetDecodeArg(unsigned int Arg,const char *Label);
+ *
+ * PARAMETERS:
+ *    Arg [I] -- The argv index of the arg the help block is on (0 if the
+ *               arg isn't one we are decoding)
+ *    Label [I] -- The label of the arg
+ *
+ * FUNCTION:
+ *    This function is called when the help block gets to a new arg while
+ *    decoding args.  CLI_CmdHelp_ArgType() uses the arg this sets.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_DecodeArgs()
+ ******************************************************************************/
+static void CLI_SetDecodeArg(unsigned int Arg,const char *Label)
+{
+    g_CLI_ActiveCLI->DecodeArg=Arg;
+    if(Arg>0 && Arg<=CLI_TYPED_ARGS)
+        g_CLI_ActiveCLI->TypedArgs[Arg-1].Label=Label;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_DecodeOption
+ *
+ * SYNOPSIS:
+ *    static void CLI_DecodeOption(int Level,const char *Option);
+ *
+ * PARAMETERS:
+ *    Level [I] -- The level from CLI_CmdHelp_OptionString() (0=argv[1])
+ *    Option [I] -- The option string
+ *
+ * FUNCTION:
+ *    This function is called for each CLI_CmdHelp_OptionString() while
+ *    decoding args.  If the arg matches the option the index of the option
+ *    is saved for the arg (the first match wins) and the sub args that
+ *    follow are for the args after it.
+ *
+ *    This is called for every option in the help block, so the arg is
+ *    only compared when the first char matches and not at all after it
+ *    has found its option.  The first char is checked with A-Z as a-z so
+ *    this works if STRNCMP() ignores case or not.
+ *
+ * RETURNS:
+ *    NONE
+ *
+ * SEE ALSO:
+ *    CLI_DecodeArgs(), CLI_GetOptionIndex()
+ ******************************************************************************/
+static void CLI_DecodeOption(int Level,const char *Option)
+{
+    struct CLITypedArg *Arg;
+    const char *Str;
+    unsigned int len;
+    bool Match;
+
+    if(Level<0)
+        return;
+
+    Arg=NULL;
+    if(Level<CLI_TYPED_ARGS)
+        Arg=&g_CLI_ActiveCLI->TypedArgs[Level];
+
+    Match=false;
+    if(Level+1<g_CLI_ActiveCLI->DecodeArgc &&
+            (Arg==NULL || Arg->Option==CLI_NO_OPTION))
+    {
+        Str=g_CLI_ActiveCLI->DecodeArgv[Level+1];
+        if(CLI_ToLower(Str[0])==CLI_ToLower(Option[0]))
+        {
+            len=STRLEN(Option);
+            Match=(STRNCMP(Str,Option,len)==0 && Str[len]==0);
+        }
+    }
+    g_CLI_ActiveCLI->DecodeSubArg=Match?Level+2:0;
+
+    if(Arg==NULL)
+        return;
+
+    if(Match)
+        Arg->Option=Arg->OptionCount;
+    if(Arg->OptionCount<CLI_NO_OPTION-1)
+        Arg->OptionCount++;
+}
+
+/*******************************************************************************
+ * NAME:
+ *    CLI_DecodeNumber
+ *
+ * SYNOPSIS:
+ *    static bool CLI_DecodeNumber(const char *Str,bool Hex,int32_t *Value);
+ *
+ * PARAMETERS:
+ *    Str [I] -- The arg to decode
+ *    Hex [I] -- true = the number is in hex (with an optional 0x),
+ *               false = the number is decimal (with an optional - or +)
+ *    Value [O] -- The number (hex numbers over 0x7FFFFFFF are negative)
+ *
+ * FUNCTION:
+ *    This function decodes a number for a e_CLIArg_Int or e_CLIArg_Hex arg.
+ *    The whole arg must be the number and it must fit in 32 bits.
+ *
+ * RETURNS:
+ *    true -- The number was good
+ *    false -- The arg isn't a number (or is too big).  'Value' isn't
+ *             changed.
+ *
+ * SEE ALSO:
+ *    CLI_DecodeArgs()
+ ******************************************************************************/
+static bool CLI_DecodeNumber(const char *Str,bool Hex,int32_t *Value)
+{
+    uint32_t Num;
+    uint32_t Max;
+    uint32_t Base;
+    uint32_t Digit;
+    bool Neg;
+
+    Neg=false;
+    if(Hex)
+    {
+        if(Str[0]=='0' && (Str[1]=='x' || Str[1]=='X'))
+            Str+=2;
+        Base=16;
+        Max=0xFFFFFFFFU;
+    }
+    else
+    {
+        if(*Str=='-' || *Str=='+')
+        {
+            Neg=(*Str=='-');
+            Str++;
+        }
+        Base=10;
+        Max=Neg?0x80000000U:0x7FFFFFFFU;
+    }
+
+    if(*Str==0)
+        return false;
+
+    Num=0;
+    for(;*Str!=0;Str++)
+    {
+        if(*Str>='0' && *Str<='9')
+            Digit=*Str-'0';
+        else if(Hex && *Str>='a' && *Str<='f')
+            Digit=*Str-'a'+10;
+        else if(Hex && *Str>='A' && *Str<='F')
+            Digit=*Str-'A'+10;
+        else
+            return false;
+
+        if(Num>(Max-Digit)/Base)
+            return false;
+        Num=Num*Base+Digit;
+    }
+
+    if(Neg)
+        *Value=(int32_t)(0-Num);
+    else
+        *Value=(int32_t)Num;
+    return true;
 }
+#endif
+
 #else
 /* Short version of CLI_ShowCmdHelp() */
 void CLI_ShowCmdHelp(void)
@@ -1664,9 +5079,10 @@ void CLI_ShowCmdHelp(void)
         return;
     }
 
-    CLIPrintStr(g_CLI_ActiveCLI->RunningCmd->Cmd);
-    CLIPrintStr(" -- ");
-    CLIPrintStr(g_CLI_ActiveCLI->RunningCmd->Help);
-    CLIPrintStr("\r\n");
+    CLIPrintStr(g_CLI_ActiveCLI,g_CLI_ActiveCLI->RunningCmd->Cmd);
+    CLIPrintStr(g_CLI_ActiveCLI," -- ");
+    CLIPrintStr(g_CLI_ActiveCLI,g_CLI_ActiveCLI->RunningCmd->Help);
+    CLIPrintStr(g_CLI_ActiveCLI,"\r\n");
+    CLI_FlushOutput(g_CLI_ActiveCLI);
 }
 #endif